@@ -0,0 +1,485 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Microbenchmarks of the shell. Every benchmark is run a few times to
+ * warm up and then measured several times; the median and the 99th
+ * percentile of the runs are printed as tab separated values:
+ *
+ *   name	median	p99	unit	runs
+ *
+ * Two outputs can be compared with compare.sh.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cmd.h"
+#include "arena.h"
+#include "plan.h"
+#include "my_string.h"
+
+#define WARMUP_RUNS		3
+#define DEFAULT_RUNS		30
+
+#define PARSE_LINES		10000
+/* A generated line of 1 MiB, made of 64 long words. */
+#define LONG_LINE_WORDS		64
+#define LONG_WORD_SIZE		(16 * 1024)
+#define LONG_LINE_PARSES	20
+/* The lines of the tests of the parser, valid or not. */
+#ifndef PARSER_TESTS
+#define PARSER_TESTS		"../util/parser/tests"
+#endif
+#define TEST_LINES_PASSES	100
+#define ARGV_CALLS		100000
+/* A word made of many variables, e.g. a long PATH built piece by piece. */
+#define WORD_PARTS		300
+#define WORD_CALLS		2000
+#define STRLEN_PASSES		1000
+#define EXEC_COMMANDS		100
+#define PIPE_DATA_SIZE		(32 * 1024 * 1024)
+#define FAN_OUT			16
+
+struct bench {
+	const char *name;
+	const char *unit;
+	/* One run; it returns the measured value. */
+	double (*run)(const void *arg);
+	const void *arg;
+	/* Fewer runs for the slow benchmarks. */
+	int runs_divisor;
+};
+
+struct lines {
+	char **lines;
+	size_t nr_lines;
+	size_t size;
+};
+
+/* File read by the pipeline benchmarks. */
+static char data_path[] = "/tmp/mini-shell-bench-XXXXXX";
+/* Some of the lines of the tests of the parser are invalid on purpose. */
+static bool quiet_parse_errors;
+
+void parse_error(const char *str, const int where)
+{
+	if (!quiet_parse_errors)
+		fprintf(stderr, "bench: parse error near %d: %s\n", where, str);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*****
+ * Parse a line which must be valid.
+ *****/
+static command_t *parse(const char *line)
+{
+	command_t *root = NULL;
+
+	if (!parse_line(line, &root) || !root) {
+		fprintf(stderr, "bench: can not parse '%s'\n", line);
+		exit(EXIT_FAILURE);
+	}
+	return root;
+}
+
+/*****
+ * @return nanoseconds per parsed line
+ *****/
+static double bench_parse(const void *arg)
+{
+	const char *line = arg;
+	double start = now();
+
+	for (int i = 0; i < PARSE_LINES; ++i) {
+		parse(line);
+		free_parse_memory();
+	}
+	return (now() - start) * 1e9 / PARSE_LINES;
+}
+
+/*****
+ * @return nanoseconds per line of the tests of the parser
+ *****/
+static double bench_parse_tests(const void *arg)
+{
+	const struct lines *t = arg;
+	double start = now();
+
+	quiet_parse_errors = true;
+	for (int i = 0; i < TEST_LINES_PASSES; ++i)
+		for (size_t j = 0; j < t->nr_lines; ++j) {
+			command_t *root = NULL;
+
+			parse_line(t->lines[j], &root);
+			free_parse_memory();
+		}
+	quiet_parse_errors = false;
+
+	return (now() - start) * 1e9 / (TEST_LINES_PASSES * t->nr_lines);
+}
+
+/*****
+ * @return MiB per second of a long line parsed
+ *****/
+static double bench_parse_long(const void *arg)
+{
+	const char *line = arg;
+	double start = now();
+
+	for (int i = 0; i < LONG_LINE_PARSES; ++i) {
+		parse(line);
+		free_parse_memory();
+	}
+	return strlen(line) * LONG_LINE_PARSES / (1024.0 * 1024.0) / (now() - start);
+}
+
+/*****
+ * @return nanoseconds per line found in the plan cache
+ *****/
+static double bench_plan_find(const void *arg)
+{
+	const char *line = arg;
+
+	if (!plan_find(line)) {
+		plan_compile(line, parse(line));
+		free_parse_memory();
+	}
+
+	double start = now();
+
+	for (int i = 0; i < PARSE_LINES; ++i)
+		if (!plan_find(line)) {
+			fprintf(stderr, "bench: '%s' is not in the plan cache\n", line);
+			exit(EXIT_FAILURE);
+		}
+	return (now() - start) * 1e9 / PARSE_LINES;
+}
+
+/*****
+ * @return nanoseconds per argv built, for calls argvs of the command
+ *****/
+static double build_argvs(const char *line, int calls)
+{
+	simple_command_t *s = parse(line)->scmd;
+	double start = now();
+
+	for (int i = 0; i < calls; ++i) {
+		if (!get_params(s->verb, s->params)) {
+			fprintf(stderr, "bench: get_params failed\n");
+			exit(EXIT_FAILURE);
+		}
+		if (i % 1000 == 999)
+			arena_reset();
+	}
+
+	double ns = (now() - start) * 1e9 / calls;
+
+	arena_reset();
+	free_parse_memory();
+	return ns;
+}
+
+static double bench_argv(const void *arg)
+{
+	return build_argvs(arg, ARGV_CALLS);
+}
+
+static double bench_long_word(const void *arg)
+{
+	return build_argvs(arg, WORD_CALLS);
+}
+
+/*****
+ * @return MiB per second scanned by my_strlen(), over the lines
+ *****/
+static double bench_strlen(const void *arg)
+{
+	const struct lines *t = arg;
+	size_t total = 0;
+	double start = now();
+
+	for (int i = 0; i < STRLEN_PASSES; ++i)
+		for (size_t j = 0; j < t->nr_lines; ++j)
+			total += my_strlen(t->lines[j]);
+	return total / (1024.0 * 1024.0) / (now() - start);
+}
+
+/*****
+ * @return microseconds per run of the command
+ *****/
+static double bench_command(const void *arg)
+{
+	command_t *root = parse(arg);
+	double start = now();
+
+	for (int i = 0; i < EXEC_COMMANDS; ++i) {
+		parse_command(root, 0, NULL);
+		arena_reset();
+	}
+
+	double us = (now() - start) * 1e6 / EXEC_COMMANDS;
+
+	free_parse_memory();
+	return us;
+}
+
+/*****
+ * @return MiB per second pushed through the pipeline
+ *****/
+static double bench_pipeline(const void *arg)
+{
+	command_t *root = parse(arg);
+	double start = now();
+
+	parse_command(root, 0, NULL);
+
+	double seconds = now() - start;
+
+	arena_reset();
+	free_parse_memory();
+	return PIPE_DATA_SIZE / (1024.0 * 1024.0) / seconds;
+}
+
+/*****
+ * @return a line which runs n commands with the same separator, e.g.
+ *		   "true & true & true"
+ *****/
+static char *repeat(const char *first, const char *next, const char *last, int n)
+{
+	size_t size = strlen(first) + (n - 2) * strlen(next) + strlen(last) + 1;
+	char *line = malloc(size);
+
+	if (!line) {
+		perror("bench: malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	strcpy(line, first);
+	for (int i = 0; i < n - 2; ++i)
+		strcat(line, next);
+	strcat(line, last);
+	return line;
+}
+
+/*****
+ * @return "echo" and long words, half of them in single quotes, e.g.
+ *		   "echo abc/def.c 'text ; | & text'"
+ *****/
+static char *long_line(void)
+{
+	static const char plain[] = "abcdefghijklmnopqrstuvwxyz/0123456789.c";
+	static const char quoted[] = "text with ; | & > and $ in quotes ";
+	char *line = malloc(5 + LONG_LINE_WORDS * (LONG_WORD_SIZE + 3) + 1);
+	char *p = line;
+
+	if (!line) {
+		perror("bench: malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	p = stpcpy(p, "echo");
+	for (int i = 0; i < LONG_LINE_WORDS; ++i) {
+		const char *text = i % 2 ? quoted : plain;
+		size_t len = strlen(text);
+
+		*p++ = ' ';
+		if (i % 2)
+			*p++ = '\'';
+		for (size_t j = 0; j < LONG_WORD_SIZE; ++j)
+			*p++ = text[j % len];
+		if (i % 2)
+			*p++ = '\'';
+	}
+	*p = '\0';
+	return line;
+}
+
+/*****
+ * Read the lines of PARSER_TESTS/\*.txt, without their newlines.
+ *****/
+static struct lines *parser_test_lines(void)
+{
+	static struct lines t;
+	glob_t files;
+	char *line = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	if (glob(PARSER_TESTS "/*.txt", 0, NULL, &files) || !files.gl_pathc) {
+		fprintf(stderr, "bench: no tests in %s\n", PARSER_TESTS);
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < files.gl_pathc; ++i) {
+		FILE *f = fopen(files.gl_pathv[i], "r");
+
+		if (!f) {
+			perror(files.gl_pathv[i]);
+			exit(EXIT_FAILURE);
+		}
+
+		while ((len = getline(&line, &size, f)) != -1) {
+			if (len && line[len - 1] == '\n')
+				line[len - 1] = '\0';
+
+			if (t.nr_lines == t.size) {
+				t.size = t.size ? 2 * t.size : 128;
+				t.lines = realloc(t.lines, t.size * sizeof(char *));
+			}
+			if (!t.lines || !(t.lines[t.nr_lines++] = strdup(line))) {
+				perror("bench: malloc");
+				exit(EXIT_FAILURE);
+			}
+		}
+		fclose(f);
+	}
+
+	free(line);
+	globfree(&files);
+	return &t;
+}
+
+/*****
+ * Create the file read by the pipeline benchmarks.
+ *****/
+static void create_data(void)
+{
+	static char block[64 * 1024];
+	int fd = mkstemp(data_path);
+
+	if (fd == -1) {
+		perror("bench: mkstemp");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < sizeof(block); ++i)
+		block[i] = i % 64 == 63 ? '\n' : 'a' + i % 26;
+	for (size_t done = 0; done < PIPE_DATA_SIZE; done += sizeof(block))
+		if (write(fd, block, sizeof(block)) != sizeof(block)) {
+			perror("bench: write");
+			exit(EXIT_FAILURE);
+		}
+	close(fd);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*****
+ * Run a benchmark and print its line.
+ *****/
+static void run_bench(const struct bench *b, int runs)
+{
+	runs /= b->runs_divisor;
+	if (runs < 3)
+		runs = 3;
+
+	double *samples = malloc(runs * sizeof(double));
+
+	if (!samples) {
+		perror("bench: malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < WARMUP_RUNS; ++i)
+		b->run(b->arg);
+	for (int i = 0; i < runs; ++i)
+		samples[i] = b->run(b->arg);
+
+	qsort(samples, runs, sizeof(double), compare_doubles);
+
+	/* Nearest rank. */
+	int p99 = (runs * 99 + 99) / 100 - 1;
+
+	printf("%s\t%.3f\t%.3f\t%s\t%d\n", b->name, samples[runs / 2], samples[p99],
+	       b->unit, runs);
+	fflush(stdout);
+	free(samples);
+}
+
+/*****
+ * @return true, if the benchmark was chosen on the command line
+ *****/
+static bool selected(const char *name, char **names, int nr_names)
+{
+	if (!nr_names)
+		return true;
+
+	for (int i = 0; i < nr_names; ++i)
+		if (strstr(name, names[i]))
+			return true;
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	int runs = DEFAULT_RUNS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		if (opt != 'r' || atoi(optarg) <= 0) {
+			fprintf(stderr, "usage: %s [-r runs] [name ...]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		runs = atoi(optarg);
+	}
+
+	create_data();
+
+	const char *line = "ls -l $HOME/dir > out.txt 2>> err.txt | grep -v foo && "
+			   "echo \"done $USER\" || true ; sort -n < in.txt";
+	struct lines *tests = parser_test_lines();
+	char *cat = NULL;
+
+	asprintf(&cat, "cat -u %s", data_path);
+
+	const struct bench benches[] = {
+		{ "parse_line", "ns/line", bench_parse, line, 1 },
+		{ "parse_1mib", "MiB/s", bench_parse_long, long_line(), 1 },
+		{ "parse_tests", "ns/line", bench_parse_tests, tests, 1 },
+		{ "plan_find", "ns/line", bench_plan_find, line, 1 },
+		{ "get_params", "ns/call",
+		  bench_argv, "gcc -O2 -Wall -c -o main.o main.c -I. -DNDEBUG", 1 },
+		{ "env_expansion", "ns/call",
+		  bench_argv, "printf $HOME $PATH x$USER/y$SHELL $MISSING", 1 },
+		{ "long_word", "ns/call", bench_long_word,
+		  repeat("echo $HOME", ":$HOME", ":$HOME", WORD_PARTS), 1 },
+		{ "strlen_tests", "MiB/s", bench_strlen, tests, 1 },
+		{ "exec_true", "us/cmd", bench_command, "/bin/true", 5 },
+		{ "builtin_echo", "us/cmd", bench_command, "echo hello > /dev/null", 1 },
+		{ "pipeline_2", "MiB/s",
+		  bench_pipeline, repeat(cat, " | cat -u", " | cat -u > /dev/null", 2), 5 },
+		{ "pipeline_4", "MiB/s",
+		  bench_pipeline, repeat(cat, " | cat -u", " | cat -u > /dev/null", 4), 5 },
+		{ "pipeline_8", "MiB/s",
+		  bench_pipeline, repeat(cat, " | cat -u", " | cat -u > /dev/null", 8), 5 },
+		{ "fan_out_16", "us/group",
+		  bench_command, repeat("/bin/true", " & /bin/true", " & /bin/true", FAN_OUT), 5 },
+	};
+
+	printf("# name\tmedian\tp99\tunit\truns\n");
+	for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); ++i)
+		if (selected(benches[i].name, argv + optind, argc - optind))
+			run_bench(&benches[i], runs);
+
+	unlink(data_path);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,27 @@
+#!/bin/bash
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Compare two outputs of the benchmarks (make bench), e.g.
+#   ./compare.sh baseline.tsv results.tsv
+# The change is positive when the new run is better (faster, or more MiB/s).
+
+if [ $# -ne 2 ]; then
+	echo "usage: $0 old.tsv new.tsv" >&2
+	exit 1
+fi
+
+awk -F'\t' '
+	/^#/ { next }
+	NR == FNR { old[$1] = $2; next }
+	{
+		if (!($1 in old)) {
+			printf "%-16s %12s %12.3f %-10s %8s\n", $1, "-", $2, $4, "new"
+			next
+		}
+		change = old[$1] ? ($2 - old[$1]) / old[$1] * 100 : 0
+		# For times, lower is better.
+		if ($4 !~ /\/s$/ && change)
+			change = -change
+		printf "%-16s %12.3f %12.3f %-10s %+7.1f%%\n", $1, old[$1], $2, $4, change
+	}
+' "$1" "$2"
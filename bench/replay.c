@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+/*
+ * Replay of the test inputs. Every input is given as stdin to a shell,
+ * in an empty directory, several times; the medians of the wall time, of
+ * the CPU time (user + sys, the children of the shell included) and of
+ * the peak RSS are printed as tab separated values:
+ *
+ *   input	shell	wall_ms	cpu_ms	maxrss_kb	runs
+ *
+ * The output of the shell is thrown away. replay.sh compares the results
+ * of mini-shell with a baseline.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include <fcntl.h>
+#include <ftw.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_RUNS		5
+
+struct sample {
+	double wall_ms;
+	double cpu_ms;
+	long maxrss_kb;
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+/*****
+ * Run a shell once, with the input as stdin, in a new empty directory.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ *****/
+static int replay(const char *shell, const char *input, struct sample *sample)
+{
+	char dir[] = "/tmp/mini-shell-replay-XXXXXX";
+	struct rusage ru;
+	int status, failed = 0;
+	/* The child reports a failed exec through a pipe closed by exec. */
+	int report[2];
+
+	if (!mkdtemp(dir)) {
+		perror("replay: mkdtemp");
+		return -1;
+	}
+	if (pipe2(report, O_CLOEXEC) == -1) {
+		perror("replay: pipe2");
+		return -1;
+	}
+
+	double start = now();
+	pid_t pid = fork();
+
+	if (pid == -1) {
+		perror("replay: fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		int in = open(input, O_RDONLY);
+		int null = open("/dev/null", O_WRONLY);
+
+		if (in != -1 && null != -1 && chdir(dir) != -1 &&
+		    dup2(in, 0) != -1 && dup2(null, 1) != -1 && dup2(null, 2) != -1)
+			execlp(shell, shell, (char *)NULL);
+		failed = 1;
+		write(report[1], &failed, sizeof(failed));
+		_exit(127);
+	}
+
+	close(report[1]);
+	if (read(report[0], &failed, sizeof(failed)) != sizeof(failed))
+		failed = 0;
+	close(report[0]);
+
+	if (wait4(pid, &status, 0, &ru) == -1) {
+		perror("replay: wait4");
+		return -1;
+	}
+
+	sample->wall_ms = (now() - start) * 1e3;
+	sample->cpu_ms = (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e3 +
+			 (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e3;
+	sample->maxrss_kb = ru.ru_maxrss;
+
+	nftw(dir, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+
+	if (failed) {
+		fprintf(stderr, "replay: can not run %s\n", shell);
+		return -1;
+	}
+	return 0;
+}
+
+/*****
+ * @return the last component of a path
+ *****/
+static const char *name_of(const char *path)
+{
+	const char *slash = strrchr(path, '/');
+
+	return slash ? slash + 1 : path;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*****
+ * @return the median of n values (they are sorted)
+ *****/
+static double median(double *values, int n)
+{
+	qsort(values, n, sizeof(double), compare_doubles);
+	return values[n / 2];
+}
+
+int main(int argc, char *argv[])
+{
+	int runs = DEFAULT_RUNS;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "r:")) != -1) {
+		if (opt != 'r' || atoi(optarg) <= 0)
+			goto usage;
+		runs = atoi(optarg);
+	}
+	if (argc - optind < 2)
+		goto usage;
+
+	const char *shell = argv[optind];
+	double *wall = malloc(3 * runs * sizeof(double));
+
+	if (!wall) {
+		perror("replay: malloc");
+		return EXIT_FAILURE;
+	}
+
+	double *cpu = wall + runs, *rss = cpu + runs;
+
+	for (int i = optind + 1; i < argc; ++i) {
+		char input[PATH_MAX];
+
+		if (!realpath(argv[i], input)) {
+			perror(argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		for (int run = 0; run < runs; ++run) {
+			struct sample sample;
+
+			if (replay(shell, input, &sample) == -1)
+				return EXIT_FAILURE;
+			wall[run] = sample.wall_ms;
+			cpu[run] = sample.cpu_ms;
+			rss[run] = sample.maxrss_kb;
+		}
+
+		printf("%s\t%s\t%.3f\t%.3f\t%.0f\t%d\n", name_of(argv[i]), name_of(shell),
+		       median(wall, runs), median(cpu, runs), median(rss, runs), runs);
+		fflush(stdout);
+	}
+
+	free(wall);
+	return EXIT_SUCCESS;
+
+usage:
+	fprintf(stderr, "usage: %s [-r runs] shell input...\n", argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,91 @@
+#!/bin/bash
+# SPDX-License-Identifier: BSD-3-Clause
+#
+# Replay the test inputs through mini-shell, bash and dash (valgrind is
+# never used) and fail when mini-shell is slower than the baseline.
+#
+#   ./replay.sh [-u] [-r runs]
+#
+#   -u  save the results of mini-shell as the new baseline
+#   -r  number of runs of every input (default 5)
+#
+# REPLAY_TOLERANCE is the allowed slowdown, in percent (default 30), and
+# REPLAY_SLACK_MS an allowed slowdown in milliseconds (default 10), so that
+# the noise of the short inputs does not fail the gate.
+#
+# mini-shell runs with the same MINISHELL_JOBS (REPLAY_JOBS, default 16) for
+# the baseline and for the gate, whatever the environment has. The baseline
+# records the machine and the settings it was taken with.
+
+cd "$(dirname "$0")" || exit 1
+
+MINI_SHELL=${MINI_SHELL:-$(pwd)/../src/mini-shell}
+REPLAY=${REPLAY:-./replay}
+BASELINE=replay_baseline.tsv
+RESULTS=${REPLAY_OUT:-replay.tsv}
+TOLERANCE=${REPLAY_TOLERANCE:-30}
+SLACK_MS=${REPLAY_SLACK_MS:-10}
+export MINISHELL_JOBS=${REPLAY_JOBS:-16}
+
+update=no
+runs=5
+while getopts "ur:" opt; do
+	case $opt in
+	u) update=yes ;;
+	r) runs=$OPTARG ;;
+	*) echo "usage: $0 [-u] [-r runs]" >&2; exit 1 ;;
+	esac
+done
+
+inputs=(../tests/_test/inputs/test_*.txt)
+
+{
+	echo -e "# input\tshell\twall_ms\tcpu_ms\tmaxrss_kb\truns"
+	for shell in "$MINI_SHELL" bash dash; do
+		command -v "$shell" &>/dev/null || continue
+		"$REPLAY" -r "$runs" "$shell" "${inputs[@]}" || exit 1
+	done
+} > "$RESULTS" || exit 1
+
+if [ "$update" = "yes" ]; then
+	cpu=$(sed -n 's/^model name[[:space:]]*: //p' /proc/cpuinfo | head -n 1)
+	{
+		echo "# machine: ${cpu:-unknown cpu}, $(nproc) cpus, $(uname -sr)"
+		echo "# settings: MINISHELL_JOBS=$MINISHELL_JOBS runs=$runs LEXER=${LEXER:-flex}"
+		grep -e '^#' -e $'\tmini-shell\t' "$RESULTS"
+	} > "$BASELINE"
+	echo "baseline saved in $BASELINE"
+fi
+
+touch "$BASELINE"
+grep -e '^# machine' -e '^# settings' "$BASELINE" | sed 's/^# /baseline /'
+awk -F'\t' -v tolerance="$TOLERANCE" -v slack="$SLACK_MS" '
+	/^#/ { next }
+	FILENAME == ARGV[1] { base_wall[$1] = $3; base_cpu[$1] = $4; next }
+	$2 != "mini-shell" { ref[$1] = ref[$1] sprintf(" %s %.1f", $2, $3); next }
+	{ order[++n] = $1; wall[$1] = $3; cpu[$1] = $4; rss[$1] = $5 }
+	END {
+		printf "%-12s %10s %10s %10s %10s  %s\n",
+		       "input", "wall_ms", "cpu_ms", "rss_kb", "base_wall", "reference wall_ms"
+		for (i = 1; i <= n; i++) {
+			t = order[i]
+			status = ""
+			if (t in base_wall) {
+				if (wall[t] > base_wall[t] * (1 + tolerance / 100) + slack ||
+				    cpu[t] > base_cpu[t] * (1 + tolerance / 100) + slack) {
+					status = "  REGRESSION"
+					failed++
+				}
+				base = sprintf("%.1f", base_wall[t])
+			} else {
+				base = "-"
+			}
+			printf "%-12s %10.1f %10.1f %10d %10s %s%s\n",
+			       t, wall[t], cpu[t], rss[t], base, ref[t], status
+		}
+		if (failed) {
+			printf "%d input(s) slower than the baseline\n", failed
+			exit 1
+		}
+	}
+' "$BASELINE" "$RESULTS"
@@ -0,0 +1,146 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "acct.h"
+#include "env.h"
+#include "my_string.h"
+#include "my_stdio.h"
+
+/* The file of the accounting mode and the value of ACCT_ENV it came from. */
+static int fd = -1;
+static char *fd_path;
+static unsigned long fd_generation = -1;
+
+/* The largest RSS of the children reaped since acct_begin(). */
+static long reaped_maxrss;
+
+int acct_fd(void)
+{
+	/* The environment did not change since the last call. */
+	if (fd_generation == env_generation())
+		return fd;
+	fd_generation = env_generation();
+
+	const char *path = env_get(ACCT_ENV);
+
+	if (path && fd_path && !my_strcmp(path, fd_path))
+		return fd;
+
+	if (fd > STDERR_FILENO)
+		close(fd);
+	free(fd_path);
+	fd_path = NULL;
+	fd = -1;
+
+	if (!path)
+		return -1;
+
+	fd_path = strdup(path);
+	if (!path[0] || !my_strcmp(path, "-"))
+		fd = STDERR_FILENO;
+	else
+		fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	return fd;
+}
+
+/*****
+ * @return b - a, in seconds
+ *****/
+static double elapsed(const struct timeval *a, const struct timeval *b)
+{
+	return (b->tv_sec - a->tv_sec) + (b->tv_usec - a->tv_usec) / 1e6;
+}
+
+/*****
+ * Write one line of the report.
+ *****/
+static void report(int fd, double real, double user, double sys,
+		   const struct rusage *ru, const char *what)
+{
+	char line[4096];
+	int len;
+
+	len = snprintf(line, sizeof(line),
+		       "%.3fs real %.3fs user %.3fs sys %ldk rss %ld/%ld csw %ld/%ld flt\t%s\n",
+		       real, user, sys, ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw,
+		       ru->ru_majflt, ru->ru_minflt, what ? what : "");
+	if (len >= (int)sizeof(line))
+		len = sizeof(line) - 1;
+	my_fwrite(line, len, 1, fd);
+}
+
+/*****
+ * @return the time passed since start, in seconds
+ *****/
+static double since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+void acct_child(int fd, const struct timespec *start, const struct rusage *ru,
+		const char *what)
+{
+	struct timeval zero = { 0 };
+
+	report(fd, since(start), elapsed(&zero, &ru->ru_utime),
+	       elapsed(&zero, &ru->ru_stime), ru, what);
+}
+
+void acct_reaped(const struct rusage *ru)
+{
+	if (ru->ru_maxrss > reaped_maxrss)
+		reaped_maxrss = ru->ru_maxrss;
+}
+
+void acct_begin(struct acct *acct)
+{
+	acct->maxrss = reaped_maxrss;
+	reaped_maxrss = 0;
+	getrusage(RUSAGE_SELF, &acct->self);
+	getrusage(RUSAGE_CHILDREN, &acct->children);
+	clock_gettime(CLOCK_MONOTONIC, &acct->start);
+}
+
+void acct_end(int fd, const struct acct *acct, const char *what)
+{
+	struct rusage self, children, ru;
+	double real = since(&acct->start);
+
+	getrusage(RUSAGE_SELF, &self);
+	getrusage(RUSAGE_CHILDREN, &children);
+
+	/*
+	 * RUSAGE_CHILDREN has the largest RSS of all the children ever
+	 * reaped, so only the ones reaped for this command are used.
+	 */
+	ru.ru_maxrss = reaped_maxrss;
+	if (acct->maxrss > reaped_maxrss)
+		reaped_maxrss = acct->maxrss;
+	ru.ru_nvcsw = self.ru_nvcsw - acct->self.ru_nvcsw +
+		      children.ru_nvcsw - acct->children.ru_nvcsw;
+	ru.ru_nivcsw = self.ru_nivcsw - acct->self.ru_nivcsw +
+		       children.ru_nivcsw - acct->children.ru_nivcsw;
+	ru.ru_majflt = self.ru_majflt - acct->self.ru_majflt +
+		       children.ru_majflt - acct->children.ru_majflt;
+	ru.ru_minflt = self.ru_minflt - acct->self.ru_minflt +
+		       children.ru_minflt - acct->children.ru_minflt;
+
+	report(fd, real,
+	       elapsed(&acct->self.ru_utime, &self.ru_utime) +
+	       elapsed(&acct->children.ru_utime, &children.ru_utime),
+	       elapsed(&acct->self.ru_stime, &self.ru_stime) +
+	       elapsed(&acct->children.ru_stime, &children.ru_stime),
+	       &ru, what);
+}
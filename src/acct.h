@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _ACCT_H
+#define _ACCT_H
+
+#include <sys/resource.h>
+#include <time.h>
+
+/*
+ * Resource accounting, for the time builtin and for the accounting mode.
+ * When MINISHELL_ACCT is set, every external command, pipeline stage and
+ * member of a parallel group is reported, one line per child, in the file
+ * it names (or on stderr, if it is "-" or empty). A line looks like:
+ *
+ *   0.501s real 0.000s user 0.001s sys 1920k rss 2/0 csw 0/87 flt	sleep 0.5
+ *
+ * with the voluntary/involuntary context switches and the major/minor
+ * page faults.
+ */
+
+#define ACCT_ENV		"MINISHELL_ACCT"
+
+/* Snapshot of the shell, for the commands which are not single children. */
+struct acct {
+	struct timespec start;
+	struct rusage self;
+	struct rusage children;
+	/* The largest RSS of the children reaped before, for nested commands. */
+	long maxrss;
+};
+
+/**
+ * @return the file in which the children are reported
+ *		   -1, if the accounting mode is off
+ */
+int acct_fd(void);
+
+/**
+ * Report a child which finished.
+ *
+ * @param fd file in which the child is reported
+ * @param start when the child was started (CLOCK_MONOTONIC)
+ * @param ru the resource usage given by the reaper
+ * @param what the command run by the child
+ */
+void acct_child(int fd, const struct timespec *start, const struct rusage *ru,
+		const char *what);
+
+/**
+ * Remember the resource usage of a child which was reaped. The reaper
+ * calls it for every child it reaps.
+ */
+void acct_reaped(const struct rusage *ru);
+
+/**
+ * Take a snapshot of the shell and of its children, before a command.
+ */
+void acct_begin(struct acct *acct);
+
+/**
+ * Report everything used since acct_begin() by the shell and by the
+ * children it reaped. The RSS is the largest one of those children.
+ */
+void acct_end(int fd, const struct acct *acct, const char *what);
+
+#endif /* _ACCT_H */
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <stddef.h>
+
+#include "arena.h"
+#include "stats.h"
+
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+#define ARENA_ALIGN		16
+
+struct arena_chunk {
+	struct arena_chunk *prev;
+	size_t size;
+	size_t used;
+	/* The allocations start here. */
+	char mem[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+/* The chunk from which we allocate; the older ones are linked by prev. */
+static struct arena_chunk *current;
+
+/*****
+ * Map a new chunk, big enough for size bytes, and make it the current one.
+ *
+ * @return the new chunk
+ *		   NULL, if mmap failed
+ *****/
+static struct arena_chunk *new_chunk(size_t size)
+{
+	size_t chunk_size = sizeof(struct arena_chunk) + size;
+
+	if (chunk_size < ARENA_CHUNK_SIZE)
+		chunk_size = ARENA_CHUNK_SIZE;
+
+	struct arena_chunk *chunk = mmap(0, chunk_size, PROT_READ | PROT_WRITE,
+					 MAP_PRIVATE | MAP_ANON, -1, 0);
+
+	stat_inc(STAT_MMAPS);
+	if (chunk == MAP_FAILED)
+		return NULL;
+
+	chunk->prev = current;
+	chunk->size = chunk_size - sizeof(struct arena_chunk);
+	chunk->used = 0;
+	current = chunk;
+	return chunk;
+}
+
+void *arena_alloc(size_t size)
+{
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	if (!current || current->size - current->used < size)
+		if (!new_chunk(size))
+			return NULL;
+
+	void *mem = current->mem + current->used;
+
+	current->used += size;
+	return mem;
+}
+
+void arena_reset(void)
+{
+	if (!current)
+		return;
+
+	while (current->prev) {
+		struct arena_chunk *prev = current->prev;
+
+		munmap(current, current->size + sizeof(struct arena_chunk));
+		current = prev;
+	}
+	current->used = 0;
+
+	/* A chunk made for one big allocation is not worth keeping. */
+	if (current->size + sizeof(struct arena_chunk) > ARENA_CHUNK_SIZE) {
+		munmap(current, current->size + sizeof(struct arena_chunk));
+		current = NULL;
+	}
+}
@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <sys/types.h>
+
+/*
+ * Bump allocator for the memory needed while a command line runs (the
+ * argv arrays, the names of the redirection files, messages). Nothing is
+ * freed separately; everything is released at once by arena_reset(),
+ * after each command line.
+ */
+
+/**
+ * @param size number of bytes needed
+ * @return memory aligned for any type
+ *		   NULL, if there is no more memory
+ */
+void *arena_alloc(size_t size);
+
+/**
+ * Release everything allocated since the last reset. The first chunk
+ * is kept, so a typical command line needs no system call at all.
+ */
+void arena_reset(void);
+
+#endif /* _ARENA_H */
@@ -0,0 +1,710 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "builtins.h"
+#include "my_string.h"
+#include "my_stdio.h"
+#include "path_cache.h"
+#include "env.h"
+#include "arena.h"
+#include "jobs.h"
+#include "trace.h"
+#include "stats.h"
+
+/* Slots of the dispatch table; a power of two, at least twice the builtins. */
+#define NR_SLOTS		64
+
+/* Where an escape sequence is found; they are not the same for all. */
+enum escape_mode {
+	/* echo -e: octal as \0NNN, \c stops the output */
+	ESCAPE_ECHO,
+	/* the format of printf: octal as \NNN, \c is not special */
+	ESCAPE_FORMAT,
+	/* an argument of %b: octal as \0NNN or \NNN, \c stops the output */
+	ESCAPE_ARG,
+};
+
+/* The output of a builtin goes to stdout; my_fwrite() buffers it. */
+static void put(const char *data, size_t size)
+{
+	my_fwrite(data, size, 1, STDOUT_FILENO);
+}
+
+static void put_char(char c)
+{
+	put(&c, 1);
+}
+
+/*****
+ * Print an error on stderr: "mini-shell: name: what: why".
+ *
+ * @param shell false, to leave out "mini-shell: " (for a builtin which
+ *		  stands in for a program and prints its errors, e.g. cat)
+ * @param why NULL, to leave it out
+ *****/
+static void print_error(bool shell, const char *name, const char *what, const char *why)
+{
+	struct iovec iov[] = {
+		{ "mini-shell: ", shell ? 12 : 0 },
+		{ (char *)name, my_strlen(name) },
+		{ ": ", 2 },
+		{ (char *)what, my_strlen(what) },
+		{ ": ", why ? 2 : 0 },
+		{ (char *)why, why ? my_strlen(why) : 0 },
+		{ "\n", 1 },
+	};
+
+	my_fwritev(iov, sizeof(iov) / sizeof(iov[0]), STDERR_FILENO);
+}
+
+/*****
+ * Print an error of a builtin on stderr: "mini-shell: name: what: why".
+ *
+ * @param why NULL, to leave it out
+ *****/
+static void builtin_error(const char *name, const char *what, const char *why)
+{
+	print_error(true, name, what, why);
+}
+
+/*****
+ * Decode the escape sequence which follows a backslash.
+ *
+ * @param s the characters after the backslash
+ * @param c (*)the character given by the sequence
+ * @return the number of characters of the sequence
+ *		   0, if it is not a sequence (the backslash is printed as it is)
+ *		   -1, if the sequence is \c and the output must stop
+ *****/
+static int unescape(const char *s, char *c, enum escape_mode mode)
+{
+	static const char simple[] = "a\ab\be\033E\033f\fn\nr\rt\tv\v\\\\";
+	int n = 0, value = 0;
+
+	for (size_t i = 0; simple[i]; i += 2)
+		if (*s == simple[i]) {
+			*c = simple[i + 1];
+			return 1;
+		}
+
+	switch (*s) {
+	case 'c':
+		return mode == ESCAPE_FORMAT ? 0 : -1;
+	case 'x':
+		while (n < 2 && s[n + 1] && strchr("0123456789abcdefABCDEF", s[n + 1])) {
+			char digit = s[++n];
+
+			value = value * 16 + (digit <= '9' ? digit - '0' : (digit | 0x20) - 'a' + 10);
+		}
+		if (!n)
+			return 0;
+		*c = value;
+		return n + 1;
+	case '0' ... '7':
+		if (mode == ESCAPE_ECHO && *s != '0')
+			return 0;
+		/* The leading 0 of \0NNN is not one of the digits. */
+		if (mode != ESCAPE_FORMAT && *s == '0')
+			n = 1;
+		for (int digits = 0; digits < 3 && s[n] >= '0' && s[n] <= '7'; ++digits)
+			value = value * 8 + s[n++] - '0';
+		*c = value;
+		return n;
+	default:
+		return 0;
+	}
+}
+
+/*****
+ * Decode the escape sequences of a string. The decoded string is never
+ * longer than the original one.
+ *
+ * @param dst where the decoded string is written (it is not terminated)
+ * @param stopped (*)set to true, if the string has a \c
+ * @return the length of the decoded string
+ *****/
+static size_t decode(char *dst, const char *s, enum escape_mode mode, bool *stopped)
+{
+	size_t len = 0;
+
+	while (*s) {
+		int n;
+
+		if (*s != '\\' || !(n = unescape(s + 1, &dst[len], mode))) {
+			dst[len++] = *s++;
+			continue;
+		}
+		if (n == -1) {
+			*stopped = true;
+			break;
+		}
+		len++;
+		s += n + 1;
+	}
+	return len;
+}
+
+/*****
+ * Print a string, decoding its escape sequences.
+ *
+ * @param stopped (*)set to true, if \c stops the output
+ *****/
+static void put_escaped(const char *s, enum escape_mode mode, bool *stopped)
+{
+	char *decoded = arena_alloc(my_strlen(s) + 1);
+
+	if (decoded)
+		put(decoded, decode(decoded, s, mode, stopped));
+}
+
+/**
+ * Internal exit/quit command.
+ */
+static int shell_exit(char **argv)
+{
+	my_flush();
+	trace_flush();
+	_exit(0);
+	return 0;
+}
+
+/**
+ * Internal true (and :) command.
+ */
+static int shell_true(char **argv)
+{
+	return 0;
+}
+
+/**
+ * Internal false command.
+ */
+static int shell_false(char **argv)
+{
+	return 1;
+}
+
+/**
+ * Internal change-directory command.
+ */
+static int shell_cd(char **argv)
+{
+	if (!argv[1] || argv[2])
+		return -1;
+
+	if (chdir(argv[1])) {
+		builtin_error("cd", argv[1], strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Internal pwd command. The options (-L and -P) are accepted, but the
+ * path is always the physical one.
+ */
+static int shell_pwd(char **argv)
+{
+	char path[PATH_MAX];
+
+	if (!getcwd(path, sizeof(path))) {
+		builtin_error("pwd", "getcwd", strerror(errno));
+		return -1;
+	}
+
+	put(path, my_strlen(path));
+	put_char('\n');
+	return 0;
+}
+
+/*****
+ * @return true, if the word is made only of the options of echo
+ *****/
+static bool is_echo_option(const char *word)
+{
+	if (word[0] != '-' || !word[1])
+		return false;
+
+	for (++word; *word; ++word)
+		if (*word != 'n' && *word != 'e' && *word != 'E')
+			return false;
+	return true;
+}
+
+/**
+ * Internal echo command, with the options of bash: -n (no newline),
+ * -e (escape sequences) and -E (no escape sequences).
+ */
+static int shell_echo(char **argv)
+{
+	bool newline = true, escapes = false;
+	bool stopped = false;
+	int i = 1;
+
+	for (; argv[i] && is_echo_option(argv[i]); ++i)
+		for (const char *option = argv[i] + 1; *option; ++option)
+			if (*option == 'n')
+				newline = false;
+			else
+				escapes = *option == 'e';
+
+	for (int first = i; argv[i] && !stopped; ++i) {
+		if (i != first)
+			put_char(' ');
+		if (escapes)
+			put_escaped(argv[i], ESCAPE_ECHO, &stopped);
+		else
+			put(argv[i], my_strlen(argv[i]));
+	}
+
+	if (newline && !stopped)
+		put_char('\n');
+	return 0;
+}
+
+/*****
+ * Convert an argument of printf to a number: decimal, octal (0N),
+ * hexadecimal (0xN) or the code of a character ('c or "c).
+ *
+ * @param ok (*)set to false, if the argument is not a number
+ *****/
+static long long printf_number(const char *arg, bool *ok)
+{
+	char *end;
+	long long value;
+
+	if (!arg)
+		return 0;
+	if (arg[0] == '\'' || arg[0] == '"')
+		return (unsigned char)arg[1];
+
+	errno = 0;
+	value = strtoll(arg, &end, 0);
+	if (end == arg || *end || errno) {
+		builtin_error("printf", arg, "invalid number");
+		*ok = false;
+	}
+	return value;
+}
+
+static double printf_double(const char *arg, bool *ok)
+{
+	char *end;
+	double value;
+
+	if (!arg)
+		return 0;
+
+	value = strtod(arg, &end);
+	if (end == arg || *end) {
+		builtin_error("printf", arg, "invalid number");
+		*ok = false;
+	}
+	return value;
+}
+
+/*****
+ * Print with a conversion of printf(3).
+ *****/
+static void put_format(const char *spec, ...)
+{
+	char small[256];
+	va_list args;
+	int n;
+
+	va_start(args, spec);
+	n = vsnprintf(small, sizeof(small), spec, args);
+	va_end(args);
+
+	if (n < 0)
+		return;
+	if ((size_t)n < sizeof(small)) {
+		put(small, n);
+		return;
+	}
+
+	char *large = arena_alloc(n + 1);
+
+	if (!large)
+		return;
+
+	va_start(args, spec);
+	vsnprintf(large, n + 1, spec, args);
+	va_end(args);
+	put(large, n);
+}
+
+/*****
+ * Print the format of printf once.
+ *
+ * @param args (*)the arguments not used yet; they are consumed
+ * @param ok (*)set to false, if an argument is not valid
+ * @param stopped (*)set to true, if \c stops the output
+ * @return the end of the format, if it was printed entirely
+ *		   NULL, if the format is not valid
+ *****/
+static const char *printf_once(const char *format, char ***args, bool *ok, bool *stopped)
+{
+	const char *s = format;
+
+	while (*s && !*stopped) {
+		if (*s == '\\') {
+			char c;
+			int n = unescape(s + 1, &c, ESCAPE_FORMAT);
+
+			if (n) {
+				put_char(c);
+				s += n + 1;
+			} else {
+				put_char(*s++);
+			}
+			continue;
+		}
+		if (*s != '%') {
+			put_char(*s++);
+			continue;
+		}
+		if (s[1] == '%') {
+			put_char('%');
+			s += 2;
+			continue;
+		}
+
+		/* The conversion, with "*" replaced by the argument. */
+		char spec[64];
+		size_t len = 0;
+
+		spec[len++] = *s++;
+		while (*s && strchr("#-+ 0123456789.*", *s) && len < sizeof(spec) - 24) {
+			if (*s == '*') {
+				len += snprintf(spec + len, 24, "%d",
+						(int)printf_number(**args, ok));
+				if (**args)
+					++*args;
+			} else {
+				spec[len++] = *s;
+			}
+			++s;
+		}
+
+		char conversion = *s++;
+		const char *arg = **args;
+
+		if (arg)
+			++*args;
+
+		switch (conversion) {
+		case 'd':
+		case 'i':
+			memcpy(spec + len, "lld", 4);
+			put_format(spec, printf_number(arg, ok));
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			spec[len++] = 'l';
+			spec[len++] = 'l';
+			spec[len++] = conversion;
+			spec[len] = '\0';
+			put_format(spec, (unsigned long long)printf_number(arg, ok));
+			break;
+		case 'a': case 'A':
+		case 'e': case 'E':
+		case 'f': case 'F':
+		case 'g': case 'G':
+			spec[len++] = conversion;
+			spec[len] = '\0';
+			put_format(spec, printf_double(arg, ok));
+			break;
+		case 'c':
+			/* Nothing is printed for an empty argument, except the padding. */
+			memcpy(spec + len, ".1s", 4);
+			put_format(spec, arg ? arg : "");
+			break;
+		case 's':
+			memcpy(spec + len, "s", 2);
+			put_format(spec, arg ? arg : "");
+			break;
+		case 'b': {
+			/* The argument is decoded apart, then printed with %s. */
+			char *decoded = arena_alloc(my_strlen(arg ? arg : "") + 1);
+
+			if (!decoded)
+				return NULL;
+			memcpy(spec + len, ".*s", 4);
+			put_format(spec, (int)decode(decoded, arg ? arg : "", ESCAPE_ARG,
+							stopped), decoded);
+			break;
+		}
+		default:
+			builtin_error("printf", format, "invalid format");
+			return NULL;
+		}
+	}
+	return s;
+}
+
+/**
+ * Internal printf command, with the conversions of printf(1). The format
+ * is used again while there are arguments left.
+ */
+static int shell_printf(char **argv)
+{
+	bool stopped = false;
+	bool ok = true;
+
+	if (!argv[1]) {
+		my_fwrite("usage: printf format [arguments]\n", 33, 1, 2);
+		return -1;
+	}
+
+	char **args = argv + 2;
+
+	do {
+		char **before = args;
+
+		if (!printf_once(argv[1], &args, &ok, &stopped)) {
+			ok = false;
+			break;
+		}
+		/* A format without conversions does not consume anything. */
+		if (args == before)
+			break;
+	} while (*args && !stopped);
+
+	return ok ? 0 : -1;
+}
+
+/*****
+ * The internal cat knows no options, so it is used only when no parameter
+ * starts with '-' (except "-", which means stdin).
+ *
+ * @param param list with the parameters of cat
+ * @return true, if the internal cat can run the command
+ *		   false, else
+ *****/
+static bool cat_accepts(word_t *param)
+{
+	for (; param; param = param->next_word) {
+		/* A word is made of all its parts, e.g. "-"n is -n. */
+		size_t len = 0;
+		bool dash = false;
+
+		for (word_t *part = param; part; part = part->next_part) {
+			const char *string = part->expand ? env_get(part->string) : part->string;
+
+			if (!string || !*string)
+				continue;
+			if (!len)
+				dash = string[0] == '-';
+			len += my_strlen(string);
+		}
+		if (dash && len > 1)
+			return false;
+	}
+	return true;
+}
+
+/*****
+ * Copy one file to stdout, printing an error like cat does.
+ *
+ * @param name path of the file ("-" for stdin)
+ * @return 0, if the file was copied
+ *		  -1, else
+ *****/
+static int cat_file(const char *name)
+{
+	int fd = my_strcmp(name, "-") ? open(name, O_RDONLY) : 0;
+	struct stat in, out;
+	const char *error;
+
+	/* As GNU cat: a file copied at its own end would grow forever. */
+	if (fd != -1 && fstat(fd, &in) != -1 && fstat(1, &out) != -1 &&
+	    S_ISREG(in.st_mode) && in.st_dev == out.st_dev && in.st_ino == out.st_ino) {
+		error = "input file is output file";
+	} else if (fd != -1 && my_fcopy(fd, 1) != -1) {
+		if (fd != 0)
+			close(fd);
+		return 0;
+	} else {
+		error = strerror(errno);
+	}
+
+	/* The errors are the ones of /bin/cat, which the builtin replaces. */
+	print_error(false, "cat", name, error);
+	if (fd > 0)
+		close(fd);
+	return -1;
+}
+
+/**
+ * Internal cat command. The data never leaves the kernel when the files
+ * allow it (see my_fcopy).
+ */
+static int shell_cat(char **argv)
+{
+	int status = 0;
+
+	if (!argv[1])
+		return cat_file("-");
+
+	for (int i = 1; argv[i]; ++i)
+		if (cat_file(argv[i]) == -1)
+			status = -1;
+	return status;
+}
+
+/**
+ * Internal hash command: print the cached paths, forget them all (-r)
+ * or search the given names again.
+ */
+static int shell_hash(char **argv)
+{
+	int status = 0;
+
+	if (!argv[1]) {
+		path_cache_print(1);
+		return 0;
+	}
+
+	if (!my_strcmp(argv[1], "-r") && !argv[2]) {
+		path_cache_clear();
+		return 0;
+	}
+
+	for (int i = 1; argv[i]; ++i) {
+		path_cache_forget(argv[i]);
+		if (!path_cache_lookup(argv[i])) {
+			builtin_error("hash", argv[i], "not found");
+			status = -1;
+		}
+	}
+	return status;
+}
+
+/**
+ * Internal wait command: wait for the given jobs ("%N" or a pid), or for
+ * all of them.
+ */
+static int shell_wait(char **argv)
+{
+	int status = 0;
+
+	if (!argv[1])
+		return jobs_wait(NULL);
+
+	for (int i = 1; argv[i]; ++i)
+		if (jobs_wait(argv[i]) == -1)
+			status = -1;
+	return status;
+}
+
+/**
+ * Internal jobs command.
+ */
+static int shell_jobs(char **argv)
+{
+	return jobs_print(1);
+}
+
+/**
+ * Internal stats command: print the counters of the shell, as text or as
+ * JSON (-j), or set them to 0 (-r).
+ */
+static int shell_stats(char **argv)
+{
+	bool json = false;
+
+	for (int i = 1; argv[i]; ++i) {
+		if (!my_strcmp(argv[i], "-j") || !my_strcmp(argv[i], "--json")) {
+			json = true;
+		} else if (!my_strcmp(argv[i], "-r")) {
+			stats_reset();
+			return 0;
+		} else {
+			my_fwrite("usage: stats [-j | --json | -r]\n", 32, 1, 2);
+			return -1;
+		}
+	}
+
+	stats_print(1, json);
+	return 0;
+}
+
+static const struct builtin builtins[] = {
+	{ "exit", shell_exit, NULL },
+	{ "quit", shell_exit, NULL },
+	{ "true", shell_true, NULL },
+	{ ":", shell_true, NULL },
+	{ "false", shell_false, NULL },
+	{ "cd", shell_cd, NULL },
+	{ "pwd", shell_pwd, NULL },
+	{ "echo", shell_echo, NULL },
+	{ "printf", shell_printf, NULL },
+	{ "cat", shell_cat, cat_accepts },
+	{ "hash", shell_hash, NULL },
+	{ "wait", shell_wait, NULL },
+	{ "jobs", shell_jobs, NULL },
+	{ "stats", shell_stats, NULL },
+};
+
+/* Open addressing table of the builtins, filled at the first lookup. */
+static const struct builtin *slots[NR_SLOTS];
+static bool slots_ready;
+
+/*****
+ * FNV-1a hash of a string.
+ *****/
+static unsigned int hash_name(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash & (NR_SLOTS - 1);
+}
+
+static void fill_slots(void)
+{
+	for (size_t i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+		unsigned int slot = hash_name(builtins[i].name);
+
+		while (slots[slot])
+			slot = (slot + 1) & (NR_SLOTS - 1);
+		slots[slot] = &builtins[i];
+	}
+	slots_ready = true;
+}
+
+const struct builtin *builtin_find(simple_command_t *s)
+{
+	if (!s || !s->verb || s->verb->expand || s->verb->next_part)
+		return NULL;
+
+	if (!slots_ready)
+		fill_slots();
+
+	for (unsigned int slot = hash_name(s->verb->string); slots[slot];
+	     slot = (slot + 1) & (NR_SLOTS - 1)) {
+		const struct builtin *b = slots[slot];
+
+		if (!my_strcmp(b->name, s->verb->string))
+			return !b->accepts || b->accepts(s->params) ? b : NULL;
+	}
+	return NULL;
+}
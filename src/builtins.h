@@ -0,0 +1,38 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _BUILTINS_H
+#define _BUILTINS_H
+
+#include "../util/parser/parser.h"
+
+/* After parser.h, which has its own bool when stdbool.h is not included. */
+#include <stdbool.h>
+
+/*
+ * The internal commands of the shell. They run in the process of the
+ * shell, without fork or exec, so the caller applies and cancels the
+ * redirections around them. In a pipeline, a builtin runs in the process
+ * forked for its stage. "time" is a prefix, not a builtin (see cmd.c).
+ */
+
+struct builtin {
+	const char *name;
+	/* Run the command; argv is NULL terminated, argv[0] is the name. */
+	int (*run)(char **argv);
+	/*
+	 * NULL, or whether the builtin can run the command with these
+	 * parameters; if it can not, the executable with the same name is run.
+	 */
+	bool (*accepts)(word_t *params);
+};
+
+/**
+ * Find the builtin which runs a command.
+ *
+ * @param s the command
+ * @return the builtin
+ *		   NULL, if the command is not internal
+ */
+const struct builtin *builtin_find(simple_command_t *s);
+
+#endif /* _BUILTINS_H */
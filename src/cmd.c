@@ -1,48 +1,58 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#define _GNU_SOURCE
+
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
-#include <sys/mman.h>
 
-#include <fcntl.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "cmd.h"
 #include "utils.h"
 #include "my_string.h"
 #include "my_stdio.h"
+#include "launch.h"
+#include "pipes.h"
+#include "path_cache.h"
+#include "env.h"
+#include "arena.h"
+#include "reaper.h"
+#include "jobs.h"
+#include "acct.h"
+#include "trace.h"
+#include "stats.h"
+#include "builtins.h"
+#include "plan.h"
+#include "redirect.h"
 
 #define READ		0
 #define WRITE		1
 
-/****
- * Verify if the given environment variable, which has the format:
- *		name=value,
- * has the given name.
- *
- * @param env_var string of type name=value
- * @param name string with the name to which we make the match
- * @return -1, if the names does not match
- *		   position from where the value starts in first string, else
- *****/
-static int env_var_matches(const char *env_var, const char *name)
-{
-	if (!env_var || !name)
-		return -1;
+/* Maximum number of commands of a parallel group which run at once. */
+#define JOBS_ENV		"MINISHELL_JOBS"
 
-	size_t i = 0;
+/* start_external_command() could not open the redirections. */
+#define PID_REDIRECT_FAILED	-2
 
-	while (env_var[i] != '=' && name[i]) {
-		if (env_var[i] != name[i])
-			return -1;
-		i++;
-	}
+/* Wait status of a command that could not be executed (exit code -2). */
+#define STATUS_NOT_STARTED	W_EXITCODE(-2 & 0xff, 0)
 
-	if (env_var[i] != '=' || name[i])
-		return -1;
-	return i + 1;
-}
+/* Names of the operators, for tracing. */
+static const char * const op_name[OP_DUMMY] = {
+	[OP_SEQUENTIAL] = "sequential",
+	[OP_PARALLEL] = "parallel",
+	[OP_CONDITIONAL_ZERO] = "and",
+	[OP_CONDITIONAL_NZERO] = "or",
+	[OP_PIPE] = "pipe",
+	[OP_BACKGROUND] = "background",
+};
+
+/* Number of job slots given with -j (0, if it was not given). */
+static int job_slots;
 
 /*****
  * Get the value of an environment variable.
@@ -51,20 +61,14 @@ static int env_var_matches(const char *env_var, const char *name)
  * @return value of variable with the given name, if exist such a variable
  *		   "", else
  *****/
-static char *get_env_value(const char *name)
+static const char *get_env_value(const char *name)
 {
 	if (!name)
 		return NULL;
 
-	extern char **environ;
+	const char *value = env_get(name);
 
-	for (size_t i = 0; environ[i]; ++i) {
-		int pos = env_var_matches(environ[i], name);
-
-		if (pos > 0)
-			return environ[i] + pos;
-	}
-	return "";
+	return value ? value : "";
 }
 
 /*****
@@ -81,94 +85,27 @@ static char *get_string(word_t *word)
 
 	if (word->expand == false)
 		return (char *) word->string;
-	return get_env_value(word->string);
+	return (char *) get_env_value(word->string);
 }
 
 /*****
- * @param verb a list which contains the environment variable
- * @return the environment variable as string
- *		   NULL, if something bad happened
+ * Get the length of a string which represent a parameter.
+ *
+ * @param param head of the list in which is saved the string in peices
+ * @return the length of the string
  *****/
-static char *get_env_var(word_t *verb)
+static size_t get_param_size(const word_t *param)
 {
-	if (!verb)
-		return NULL;
-
-	size_t total_length = 0;
-	char *env_var = NULL;
-
-	while (verb) {
-		char *string = get_string(verb);
-		size_t new_total_length = total_length + my_strlen(string) + 1;
-		char *new_env_var = (char *)mmap(0, new_total_length, PROT_READ | PROT_WRITE,
-							MAP_PRIVATE | MAP_ANON, -1, 0);
-
-		if (new_env_var == (char *) -1)
-			return NULL;
-
-		if (env_var) {
-			my_strcpy(new_env_var, env_var);
-			munmap(env_var, total_length);
-		}
-		my_strcat(new_env_var, string);
+	size_t size = 0;
 
-		env_var = new_env_var;
-		total_length = new_total_length;
-		verb = verb->next_part;
+	while (param) {
+		if (param->expand == false)
+			size += my_strlen(param->string);
+		else
+			size += my_strlen(get_env_value(param->string));
+		param = param->next_part;
 	}
-	return env_var;
-}
-
-/*****
- * @return the number of environment variables
- *****/
-static int get_env_var_number(void)
-{
-	extern char **environ;
-	size_t i = 0;
-
-	while (environ[i])
-		i++;
-	return i;
-}
-/*****
- * Set or add a environment variable. If the variable already exists,
- * we need just to change its value. Contrary, we need to add a new variable.
- *
- * @param verb list which contains the environment variable
- * @return 0, if the function finished successfully
- *		  -1, else
- */
-static int set_env_var(word_t *verb)
-{
-	if (!verb)
-		return -1;
-
-	char *env_var = get_env_var(verb);
-	char *name = get_string(verb);
-	extern char **environ;
-
-	for (u_int i = 0; environ[i]; ++i)
-		if (env_var_matches(environ[i], name) > 0) {
-			environ[i] = env_var;
-			return 0;
-		}
-
-
-	size_t size = get_env_var_number();
-	char **new_environ = (char **)mmap(0, (size + 2) * sizeof(char *), PROT_READ | PROT_WRITE,
-						 MAP_PRIVATE | MAP_ANON, -1, 0);
-
-	if (new_environ == (char **)-1)
-		return -1;
-
-	for (int i = 0; i < size; ++i)
-		new_environ[i] = environ[i];
-	new_environ[size++] = env_var;
-	new_environ[size] = NULL;
-
-	environ = new_environ;
-	return 0;
+	return size;
 }
 
 /*****
@@ -181,193 +118,75 @@ static char *get_complete_string(word_t *word)
 	if (!word)
 		return NULL;
 
-	char *string_tail = get_complete_string(word->next_part);
-	size_t size = my_strlen(word->string) + my_strlen(string_tail);
-	char *string = (char *)mmap(0, size * sizeof(char), PROT_READ | PROT_WRITE,
-						 MAP_PRIVATE | MAP_ANON, -1, 0);
+	size_t size = get_param_size(word) + 1;
+	char *string = arena_alloc(size);
+	struct my_str str;
 
-	if (string == (char *)-1)
+	if (!string)
 		return NULL;
 
-	string[0] = '\0';
-	my_strcpy(string, get_string(word));
-	if (string_tail) {
-		my_strcat(string, string_tail);
-		munmap(string_tail, my_strlen(string_tail));
-	}
+	my_str_init(&str, string, size);
+	for (word_t *part = word; part; part = part->next_part)
+		my_str_append(&str, get_string(part));
 
 	return string;
 }
 
 /*****
- * Redirect the standard input to other file. (Other file will have the fd 0.)
- * The initial standard input will be saved at other fd.
- * If the name of the file is NULL, than *old_in = 0.
- *
- * @param in list which contains the name of the file that will be the new stdin
- * @param old_in (*)fd at which will be saved the old stdin
- * @return 0, if the function finished successfully
- *		  -1, else
- *****/
-static int redirect_input(word_t *in, int *old_in)
-{
-	if (!in || !in->string) {
-		*old_in = 0;
-		return 0;
-	}
-
-	*old_in = dup(0);
-	if (*old_in == -1)
-		return -1;
-
-	char *string = get_complete_string(in);
-	int in_fd = open(string, O_RDONLY | O_CREAT, 0744);
-
-	if (dup2(in_fd, 0) == -1)
-		return -1;
-	close(in_fd);
-
-	return 0;
-}
-
-/*****
- * Redirect the standard output to other file. (Other file will have the fd 1.)
- * The initial standard output will be saved at other fd.
- * If the name of the file is NULL, than *old_out = 1.
+ * Set or add a environment variable. If the variable already exists,
+ * we need just to change its value. Contrary, we need to add a new variable.
  *
- * @param out list which contains the name of the file that will be the new stdout
- * @param flags int which determinate in what mode we open the file
- * @param old_out (*)fd at which will be saved the old stdout
+ * @param verb list which contains the environment variable (name, "=",
+ *		  the parts of the value)
  * @return 0, if the function finished successfully
  *		  -1, else
- *****/
-static int redirect_output(word_t *out, int flags, int *old_out)
+ */
+static int set_env_var(word_t *verb)
 {
-	if (!out || !out->string) {
-		*old_out = 1;
-		return 0;
-	}
-
-	*old_out = dup(1);
-	if (*old_out == -1)
+	if (!verb || !verb->next_part)
 		return -1;
 
-	char *string = get_complete_string(out);
-	int out_fd;
+	const char *name = get_string(verb);
+	char *value = get_complete_string(verb->next_part->next_part);
 
-	if (flags & IO_OUT_APPEND)
-		out_fd = open(string, O_WRONLY | O_CREAT | O_APPEND, 0744);
-	else
-		out_fd = open(string, O_WRONLY | O_CREAT | O_TRUNC, 0744);
-
-	if (dup2(out_fd, 1) == -1)
-		return -1;
-	close(out_fd);
-
-	return 0;
+	return env_set(name, value ? value : "");
 }
 
 /*****
- * Redirect the standard error to other file. (Other file will have the fd 2.)
- * The initial standard error will be saved at other fd.
- * If the name of the file is NULL, than *old_err = 2.
- * If the out and err have the same filename, than they will share the same
- * open file structure.
- *
- * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
- * Before, we must call redirect_output().
- * !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
- *
- * @param err list which contains the name of the file that will be the new stderr
- * @param flags int which determinate in what mode we open the file
- * @param old_err (*)fd at which will be saved the old stderr
- * @param out list which contains the name of the file that will be the new stdout
- * @return 0, if the function finished successfully
- *		  -1, else
+ * dup2(), counted in the statistics.
  *****/
-static int redirect_error(word_t *err, int flags, int *old_err, word_t *out)
+static int dup_fd(int oldfd, int newfd)
 {
-	if (!err || !err->string) {
-		*old_err = 2;
-		return 0;
-	}
-
-	*old_err = dup(2);
-	if (*old_err == -1)
-		return -1;
-
-	char *err_string = get_complete_string(err);
-	char *out_string = get_complete_string(out);
-
-	if (out && !my_strcmp(err_string, out_string)) {
-		if (dup2(1, 2) == -1)
-			return -1;
-	} else {
-		int err_fd;
-
-		if (flags & IO_ERR_APPEND)
-			err_fd = open(err_string, O_WRONLY | O_CREAT | O_APPEND, 0744);
-		else
-			err_fd = open(err_string, O_WRONLY | O_CREAT | O_TRUNC, 0744);
-
-		if (dup2(err_fd, 2) == -1)
-			return -1;
-		close(err_fd);
-	}
-
-	return 0;
+	stat_inc(STAT_DUP2);
+	pipe_fd_changed(newfd);
+	return dup2(oldfd, newfd);
 }
 
 /*****
- * Redirect stdin, stdout and stderr to other files.
+ * Open the redirections of a command (see redirect.h).
  *
- * @param s command which tells the names of the new files which
- *		  will represent stdin, stdout and stderr
- * @param old_in (*)fd at which we save the old stdin
- * @param old_out (*)fd at which we save the old stdout
- * @param old_err (*)fd at which we save the old stderr
- * @return 0, if the function finished successfully
- *		  -1, else
- *****/
-static int solve_redirections(simple_command_t *s, int *old_in, int *old_out, int *old_err)
-{
-	if (redirect_input(s->in, old_in) == -1)
-		return -1;
-	if (redirect_output(s->out, s->io_flags, old_out) == -1)
-		return -1;
-	if (redirect_error(s->err, s->io_flags, old_err, s->out) == -1)
-		return -1;
-	return 0;
-}
-
-/*****
- * @param old_in fd at which we saved the original stdin
- * @param old_out fd at which we saved the original stdout
- * @param old_err fd at which we saved the original stderr
+ * @param in_fd fd which becomes stdin, if there is no input file (-1: none)
+ * @param out_fd fd which becomes stdout, if there is no output file (-1: none)
+ * @param level the level of the command, for tracing
  * @return 0, if the function finished successfully
- *		  -1, else
+ *		  -1, else (the error was printed)
  *****/
-static int cancel_redirections(int old_in, int old_out, int old_err)
+static int open_redirections(simple_command_t *s, struct redirect *r, int in_fd, int out_fd,
+			     int level)
 {
-	if (old_in != 0) {
-		if (dup2(old_in, 0) == -1)
-			return -1;
-		close(old_in);
-	}
-
-	if (old_out != 1) {
-		if (dup2(old_out, 1) == -1)
-			return -1;
-		close(old_out);
-	}
-
-	if (old_err != 2) {
-		if (dup2(old_err, 2) == -1)
-			return -1;
-		close(old_err);
-	}
-
-	return 0;
+	uint64_t start = trace_start();
+	const char *names[3] = {
+		get_complete_string(s->in),
+		get_complete_string(s->out),
+		NULL,
+	};
+	/* "&>" puts the same word in both lists. */
+	names[2] = s->err == s->out ? names[1] : get_complete_string(s->err);
+
+	int ret = redirect_open(r, names, s->io_flags, in_fd, out_fd);
+
+	trace_end("redirect", "redirect", level, start);
+	return ret;
 }
 
 /*****
@@ -390,59 +209,34 @@ size_t get_words_number(word_t *word)
 	return cnt;
 }
 
-/*****
- * Get the length of a string which represent a parameter.
- *
- * @param param head of the list in which is saved the string in peices
- * @return the length of the string
- *****/
-static size_t get_param_size(const word_t *param)
-{
-	size_t size = 0;
-
-	while (param) {
-		if (param->expand == false)
-			size += my_strlen(param->string);
-		else
-			size += my_strlen(get_env_value(param->string));
-		param = param->next_part;
-	}
-	return size;
-}
-
-/*****
- * @param verb special list which conatains the verb of the commnad
- * @param verb special list which conatains the params of the verb
- * @return an arrays of strings which represent the parameters of a command
- *		   NULL, if something bad happened
- *****/
-static char **get_params(const word_t *verb, word_t *param)
+char **get_params(const word_t *verb, word_t *param)
 {
 	if (!verb)
 		return NULL;
 
 	size_t nr_params = get_words_number(param) + 1;
-	char **params = (char **)mmap(0, (nr_params + 1) * sizeof(char *), PROT_READ | PROT_WRITE,
-					MAP_PRIVATE | MAP_ANON, -1, 0);
+	char **params = arena_alloc((nr_params + 1) * sizeof(char *));
 	size_t pos = 0;
 
-	if (params == (char **) -1)
+	if (!params)
 		return NULL;
 
+	stat_add(STAT_ARGV_BYTES, (nr_params + 1) * sizeof(char *));
 	params[pos++] =  (char *) verb->string;
 	while (param) {
 		size_t size = get_param_size(param);
 
-		params[pos] = (char *)mmap(0, (size + 1) * sizeof(char), PROT_READ | PROT_WRITE,
-					  MAP_PRIVATE | MAP_ANON, -1, 0);
-		if (params[pos] == (char *) -1)
+		stat_add(STAT_ARGV_BYTES, size + 1);
+
+		struct my_str str;
+
+		params[pos] = arena_alloc((size + 1) * sizeof(char));
+		if (!params[pos])
 			return NULL;
-		params[pos][0] = '\0';
+		my_str_init(&str, params[pos], size + 1);
 
 		while (1) {
-			char *string = get_string(param);
-
-			my_strcat(params[pos], string);
+			my_str_append(&str, get_string(param));
 
 			if (param->next_part)
 				param = param->next_part;
@@ -458,19 +252,15 @@ static char **get_params(const word_t *verb, word_t *param)
 	return params;
 }
 
-/**
- * Internal change-directory command.
- */
-static int shell_cd(word_t *dir)
+/*****
+ * @return the argv of a command: the one built when its plan was compiled,
+ *		   if its words need no expansion (see plan.h), or a new one
+ *****/
+static char **command_argv(simple_command_t *s)
 {
-	if (!dir || !dir->string || dir->next_word)
-		return -1;
-
-	int err = chdir(dir->string);
-
-	if (err)
-		return -1;
-	return 0;
+	if (s->aux)
+		return s->aux;
+	return get_params(s->verb, s->params);
 }
 
 /**
@@ -478,35 +268,296 @@ static int shell_cd(word_t *dir)
  */
 static int shell_exit(int status)
 {
+	my_flush();
+	trace_flush();
 	_exit(status);
 	return status;
 }
 
+char *get_invalid_command_message(simple_command_t *s)
+{
+	if (!s)
+		return NULL;
+
+	size_t size = my_strlen("Execution failed for ''\n") + get_param_size(s->verb);
+	char *message = arena_alloc((size + 1) * sizeof(char));
+	struct my_str str;
+
+	if (!message)
+		return NULL;
+	my_str_init(&str, message, size + 1);
+	my_str_append(&str, "Execution failed for '");
+
+	word_t *verb = s->verb;
+
+	while (verb) {
+		my_str_append(&str, get_string(verb));
+		verb = verb->next_part;
+	}
+
+	my_str_append(&str, "'\n");
+	return message;
+}
+
+/**
+ * Start a command which has an executable, without waiting for it. The
+ * files of the redirections are opened by the shell and the child is
+ * started with posix_spawn, which makes them its standard streams.
+ *
+ * @param s structure which saves the details of command
+ * @param in_fd fd which becomes the stdin of the command (-1, to inherit it)
+ * @param out_fd fd which becomes the stdout of the command (-1, to inherit it)
+ * @param group the group of the child, for the reaper
+ * @param level the level of the command, for tracing
+ * @return pid of the child
+ *		   -1, if the command could not be started
+ *		   PID_REDIRECT_FAILED, if a redirection failed (it was reported)
+ */
+static pid_t start_external_command(simple_command_t *s, int in_fd, int out_fd,
+		int group, int level)
+{
+	char **params = command_argv(s);
+
+	if (!params)
+		return -1;
+
+	struct redirect r;
+	pid_t pid = -1;
+
+	/* A child which the reaper does not know would never be reaped. */
+	if (reaper_reserve() == -1)
+		return -1;
+	/* The files are created even if the command is not found. */
+	if (open_redirections(s, &r, in_fd, out_fd, level) == -1)
+		return PID_REDIRECT_FAILED;
+
+	const char *path = path_cache_lookup(params[0]);
+
+	for (int tries = 0; path && tries < 2; ++tries) {
+		uint64_t start = trace_start();
+
+		pid = spawn_command(path, params, r.fd);
+		trace_end("exec", params[0], level, start);
+		if (pid != -1) {
+			redirect_close(&r);
+			stat_inc(STAT_EXECS);
+			reaper_add(pid, group);
+			return pid;
+		}
+		if (errno != ENOENT || path == params[0])
+			break;
+
+		/* The executable was removed since it was hashed. */
+		path_cache_forget(params[0]);
+		path = path_cache_lookup(params[0]);
+	}
+
+	redirect_close(&r);
+	stat_inc(STAT_EXEC_FAILURES);
+	return -1;
+}
+
+/*****
+ * Report a child which finished (see acct.h).
+ *
+ * @param c the command run by the child
+ *****/
+static void account_child(int fd, const struct timespec *start,
+			  const struct rusage *ru, command_t *c)
+{
+	char *text = get_command_text(c);
+
+	acct_child(fd, start, ru, text);
+	free(text);
+}
+
 /**
  * Run a command which has an executable.
  *
  * @param s structure which saves the details of command
+ * @param level the level of the command, for tracing
  * @return 0 ==> command executed succesfully
  *		  -1 ==> something bad happend during command
  *		  -2 ==> invalid command (command not found)
  */
-static int run_external_command(simple_command_t *s)
+static int run_external_command(simple_command_t *s, int level)
 {
-	char **params = get_params(s->verb, s->params);
-	pid_t pid = fork();
+	int acct = acct_fd();
+	struct timespec start;
 
-	if (pid == 0) {
-		int old_in, old_out, old_err;
+	if (acct != -1)
+		clock_gettime(CLOCK_MONOTONIC, &start);
 
-		if (solve_redirections(s, &old_in, &old_out, &old_err) == -1)
-			return -1;
-		execvp(params[0], params);
-		return shell_exit(-2);
+	pid_t pid = start_external_command(s, -1, -1, 0, level);
+
+	if (pid == PID_REDIRECT_FAILED)
+		return -1;
+	/* The child could not be started; report it like a failed exec. */
+	if (pid == -1)
+		return STATUS_NOT_STARTED;
+
+	uint64_t wait_start = trace_start();
+	struct rusage ru;
+	int status;
+
+	if (reaper_wait(pid, &status, &ru) == -1 && wait4(pid, &status, 0, &ru) != -1)
+		acct_reaped(&ru);
+	trace_end("wait", s->verb->string, level, wait_start);
+	if (acct != -1)
+		account_child(acct, &start, &ru, s->up);
+	return status;
+}
+
+/**
+ * Fork the shell. The child forgets the children of its parent, so that
+ * it can start and wait for its own.
+ *
+ * @param group the group of the child, for the reaper
+ * @param level the level of the command run by the child, for tracing
+ * @return the value returned by fork()
+ *		   -1, also if the reaper has no room for the child
+ */
+static pid_t fork_shell(int group, int level)
+{
+	uint64_t start = trace_start();
+	pid_t pid;
+
+	if (reaper_reserve() == -1)
+		return -1;
+
+	/* Otherwise, both processes would write what is buffered. */
+	my_flush();
+	pid = fork();
+
+	if (pid == 0) {
+		reaper_forget_all();
+		jobs_forget_all();
+		trace_forget();
+	} else if (pid > 0) {
+		stat_inc(STAT_FORKS);
+		reaper_add(pid, group);
+		trace_end("fork", "fork", level, start);
 	}
+	return pid;
+}
 
+/**
+ * @return true, if the command is not an internal command or an
+ *		   environment variable assignment
+ *		   false, else
+ */
+static bool is_external_command(simple_command_t *s)
+{
+	if (!s || !s->verb)
+		return false;
+
+	if (builtin_find(s) || !my_strcmp(s->verb->string, "time"))
+		return false;
+
+	if (s->verb->next_part && !my_strcmp(s->verb->next_part->string, "="))
+		return false;
+
+	return true;
+}
+
+/*****
+ * @return true, if the command is "time" followed by another command
+ *		   false, else
+ *****/
+static bool is_time_command(command_t *c)
+{
+	return c->op == OP_NONE && !my_strcmp(c->scmd->verb->string, "time") &&
+	       !c->scmd->verb->next_part && c->scmd->params;
+}
+
+/*****
+ * Remove the "time" prefix of a command. The parse tree is not changed:
+ * the command without the prefix is a copy, in the same place of the tree.
+ *
+ * @return the command without the prefix
+ *		   NULL, if something bad happened
+ *****/
+static command_t *strip_time(command_t *c)
+{
+	command_t *stripped = arena_alloc(sizeof(command_t));
+	simple_command_t *s = arena_alloc(sizeof(simple_command_t));
+
+	if (!stripped || !s)
+		return NULL;
+
+	*s = *c->scmd;
+	s->verb = c->scmd->params;
+	s->params = c->scmd->params->next_word;
+	s->up = stripped;
+	/* The argv of the plan (see plan.h) still begins with "time". */
+	s->aux = NULL;
+
+	*stripped = *c;
+	stripped->scmd = s;
+	return stripped;
+}
+
+/**
+ * Internal time command: run the rest of the command and report the time
+ * and the resources it used on stderr.
+ */
+static int shell_time(command_t *c, int level, command_t *father)
+{
+	command_t *stripped = strip_time(c);
+
+	if (!stripped)
+		return -1;
+
+	struct acct acct;
+	int status;
+
+	acct_begin(&acct);
+	status = parse_command(stripped, level, father);
+
+	char *text = get_command_text(stripped);
+
+	acct_end(STDERR_FILENO, &acct, text);
+	free(text);
+
+	/* The failure was already reported for the command, not for time. */
+	if (WEXITSTATUS(status) == 254)
+		return -1;
+	return status;
+}
+
+/*****
+ * Run an internal command in the process of the shell.
+ *
+ * @param b the builtin which runs the command
+ * @param s the command
+ * @param level the level of the command, for tracing
+ * @return the status of the builtin
+ *		   -1, if the redirections failed
+ *****/
+static int run_builtin(const struct builtin *b, simple_command_t *s, int level)
+{
+	char **argv = command_argv(s);
+	struct redirect r;
 	int status;
 
-	waitpid(pid, &status, 0);
+	if (!argv)
+		return -1;
+
+	if (open_redirections(s, &r, -1, -1, level) == -1)
+		return -1;
+	if (redirect_apply(&r) == -1)
+		return -1;
+
+	uint64_t start = trace_start();
+
+	stat_inc(STAT_BUILTINS);
+	status = b->run(argv);
+	trace_end("builtin", argv[0], level, start);
+
+	start = trace_start();
+	if (redirect_restore(&r) == -1)
+		status = -1;
+	trace_end("redirect", "restore", level, start);
 	return status;
 }
 
@@ -519,21 +570,14 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 	if (!s || !s->verb)
 		return -1;
 
-	// Built in command.
-	if (!my_strcmp(s->verb->string, "exit") || !my_strcmp(s->verb->string, "quit")) {
-		return shell_exit(0);
-	} else if (!my_strcmp(s->verb->string, "cd")) {
-		int old_in, old_out, old_err, status;
+	if (is_time_command(s->up))
+		return shell_time(s->up, level, father);
 
-		if (solve_redirections(s, &old_in, &old_out, &old_err) == -1)
-			return -1;
+	// Built in command.
+	const struct builtin *b = builtin_find(s);
 
-		status = shell_cd(s->params);
-		if (cancel_redirections(old_in, old_out, old_err) == -1)
-			return -1;
-
-		return status;
-	}
+	if (b)
+		return run_builtin(b, s, level);
 
 	//Change env variable.
 	if (s->verb->next_part && !my_strcmp(s->verb->next_part->string, "=")) {
@@ -542,134 +586,377 @@ static int parse_simple(simple_command_t *s, int level, command_t *father)
 	}
 
 	// Command which have executable.
-	return run_external_command(s);
+	return run_external_command(s, level);
+}
+
+/*****
+ * Collect the operands of a chain of the same operator (e.g. the stages of
+ * a | b | c), from left to right. The parser guarantees that an OP_PIPE
+ * subtree holds only OP_PIPE and OP_NONE nodes; for the other operators,
+ * the operands may be any command with a higher priority.
+ *
+ * @param c root of the chain
+ * @param op the operator of the chain
+ * @param cmds array in which the operands are saved (NULL, to count them)
+ * @param pos number of operands collected so far
+ * @return number of operands collected after this subtree
+ *****/
+static size_t get_group(command_t *c, operator_t op, command_t **cmds, size_t pos)
+{
+	if (c->op != op) {
+		if (cmds)
+			cmds[pos] = c;
+		return pos + 1;
+	}
+
+	pos = get_group(c->cmd1, op, cmds, pos);
+	return get_group(c->cmd2, op, cmds, pos);
+}
+
+/*****
+ * @return the maximum number of commands of a parallel group which may
+ *		   run at the same time
+ *		   SIZE_MAX, if there is no limit
+ *****/
+static size_t get_job_slots(void)
+{
+	if (job_slots > 0)
+		return job_slots;
+
+	const char *jobs = env_get(JOBS_ENV);
+
+	if (jobs && atoi(jobs) > 0)
+		return atoi(jobs);
+
+	/*
+	 * The commands of a group may depend on each other (e.g. a reader
+	 * and a writer of a fifo), so they all run at once unless asked.
+	 */
+	return SIZE_MAX;
+}
+
+void set_job_slots(int slots)
+{
+	job_slots = slots;
+}
+
+/**
+ * Start one command of a parallel group or a background job. An external
+ * command is spawned, any other command runs in a forked child.
+ *
+ * @return pid of the child
+ *		   -1, if the command could not be started
+ */
+static pid_t start_job(command_t *c, int level, int group)
+{
+	if (c->op == OP_NONE && is_external_command(c->scmd)) {
+		pid_t pid = start_external_command(c->scmd, -1, -1, group, level);
+
+		if (pid == PID_REDIRECT_FAILED)
+			return -1;
+		if (pid == -1) {
+			char *message = get_invalid_command_message(c->scmd);
+
+			my_fwrite(message, my_strlen(message), 1, 1);
+		}
+		return pid;
+	}
+
+	pid_t pid = fork_shell(group, level);
+
+	if (pid == 0)
+		shell_exit(parse_command(c, level, c->up));
+	return pid;
 }
 
 /**
- * Process two commands in parallel, by creating two children.
+ * Process a chain of commands in parallel (cmd1 & cmd2 & ... & cmdN).
+ * All of them run at the same time, unless a limit is set (-j or
+ * MINISHELL_JOBS): then, as soon as any of them finishes, the next one
+ * is started.
  */
-static int run_in_parallel(command_t *cmd1, command_t *cmd2, int level,
-		command_t *father)
+static int run_in_parallel(command_t *c, int level, command_t *father)
 {
-	if (!cmd1 || !cmd2)
+	if (!c)
 		return -1;
 
-	pid_t pid[2];
+	size_t nr_jobs = get_group(c, OP_PARALLEL, NULL, 0);
+	size_t size = nr_jobs * (sizeof(command_t *) + sizeof(pid_t) +
+				 sizeof(struct timespec));
+	char *mem = arena_alloc(size);
+	size_t slots = get_job_slots();
+	size_t next = 0, running = 0;
+	int acct = acct_fd();
+	int ret = 0;
 
-	pid[0] = fork();
-	if (!pid[0])
-		shell_exit(parse_command(cmd1, level, father));
+	if (!mem)
+		return -1;
 
-	pid[1] = fork();
-	if (!pid[1])
-		shell_exit(parse_command(cmd2, level, father));
+	int group = reaper_new_group();
 
-	int status;
+	struct timespec *start = (struct timespec *)mem;
+	command_t **jobs = (command_t **)(start + nr_jobs);
+	pid_t *pid = (pid_t *)(jobs + nr_jobs);
+
+	get_group(c, OP_PARALLEL, jobs, 0);
+
+	while (next < nr_jobs || running) {
+		while (next < nr_jobs && running < slots) {
+			if (acct != -1)
+				clock_gettime(CLOCK_MONOTONIC, &start[next]);
+			pid[next] = start_job(jobs[next], level, group);
+			if (pid[next++] != -1)
+				running++;
+			else
+				ret = -1;
+		}
+
+		if (!running)
+			break;
+
+		uint64_t wait_start = trace_start();
+		struct rusage ru;
+		int status;
+		pid_t done = reaper_wait_any(group, &status, &ru);
+
+		if (done == -1)
+			break;
+		trace_end("wait", "parallel", level, wait_start);
+		running--;
+
+		for (size_t i = 0; acct != -1 && i < next; ++i)
+			if (pid[i] == done) {
+				account_child(acct, &start[i], &ru, jobs[i]);
+				break;
+			}
+		if (!WIFEXITED(status) || WEXITSTATUS(status))
+			ret = -1;
+	}
+	return ret;
+}
+
+/*****
+ * Close the first nr_pipes pipes of a pipeline.
+ *****/
+static void close_pipes(int (*fd)[2], size_t nr_pipes)
+{
+	for (size_t i = 0; i < nr_pipes; ++i) {
+		close(fd[i][READ]);
+		close(fd[i][WRITE]);
+	}
+}
+
+/**
+ * Start a command in the background (cmd &) and return at once. The job
+ * is reaped later, by the wait and jobs builtins or after each line.
+ */
+static int run_in_background(command_t *c, int level)
+{
+	if (!c)
+		return -1;
+
+	pid_t pid = start_job(c, level, jobs_group());
+
+	if (pid == -1)
+		return -1;
 
-	for (int i = 0; i < 2; ++i) {
-		waitpid(pid[i], &status, 0);
-		if (!WIFEXITED(status) &&  WEXITSTATUS(status))
+	/* The job is shown as it was typed, with its '&'. */
+	command_t *typed = c->up && c->up->op == OP_BACKGROUND ? c->up : c;
+
+	if (jobs_add(pid, typed) == -1) {
+		/* Nobody could wait for the job later, so it is waited for now. */
+		int status;
+
+		if (reaper_wait(pid, &status, NULL) == -1)
 			return -1;
+		return WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
 	}
 	return 0;
 }
 
 /**
- * Run commands by creating an anonymous pipe (cmd1 | cmd2).
+ * Run a pipeline (cmd1 | cmd2 | ... | cmdN). All the pipes are created up
+ * front, every stage is started in its own child and the whole group is
+ * reaped at the end. External commands are spawned with the ends of the
+ * pipes as their stdin and stdout; the other stages are forked.
+ *
+ * @return the status of the last stage
+ *		   -1, if the pipeline could not be started
  */
-static int run_on_pipe(command_t *cmd1, command_t *cmd2, int level,
-		command_t *father)
+static int run_on_pipe(command_t *c, int level, command_t *father)
 {
-	if (!cmd1 || !cmd2)
+	if (!c)
 		return -1;
 
-	int fd[2];
+	size_t nr_stages = get_group(c, OP_PIPE, NULL, 0);
+	size_t nr_pipes = nr_stages - 1;
+	size_t size = nr_stages * (sizeof(command_t *) + sizeof(pid_t)) +
+		      nr_pipes * sizeof(int[2]);
+	char *mem = arena_alloc(size);
 
-	if (pipe(fd) == -1)
+	if (!mem)
 		return -1;
 
+	int (*fd)[2] = (int (*)[2])mem;
+	command_t **stages = (command_t **)(mem + nr_pipes * sizeof(int[2]));
+	pid_t *pid = (pid_t *)(stages + nr_stages);
+	size_t started = 0;
+	int group = reaper_new_group();
 	int status = -1;
-	pid_t pid = fork();
 
-	if (pid == 0) {
-		close(fd[0]);
-		if (dup2(fd[1], 1) == -1)
-			return -1;
-		close(fd[1]);
+	get_group(c, OP_PIPE, stages, 0);
 
-		shell_exit(parse_command(cmd1, level, father));
-	} else {
-		close(fd[1]);
+	/* "time a | b" times the whole pipeline, stage by stage. */
+	bool timed = is_time_command(stages[0]);
+	int acct = timed ? STDERR_FILENO : acct_fd();
+	struct acct total;
 
-		int old_in = dup(0);
+	if (timed && !(stages[0] = strip_time(stages[0])))
+		return -1;
+	if (acct != -1)
+		acct_begin(&total);
 
-		if (old_in == -1)
-			return -1;
+	/* The spawned stages must not inherit the other ends of the pipes. */
+	uint64_t pipe_start = trace_start();
 
-		if (dup2(fd[0], 0) == -1)
+	for (size_t i = 0; i < nr_pipes; ++i)
+		if (pipe_open(fd[i]) == -1) {
+			close_pipes(fd, i);
 			return -1;
-		close(fd[0]);
+		}
+	trace_end("pipe", "pipe", level, pipe_start);
+
+	for (; started < nr_stages; ++started) {
+		size_t i = started;
+		int in_fd = i > 0 ? fd[i - 1][READ] : -1;
+		int out_fd = i < nr_pipes ? fd[i][WRITE] : -1;
+
+		if (is_external_command(stages[i]->scmd)) {
+			pid[i] = start_external_command(stages[i]->scmd, in_fd, out_fd, group,
+							level);
+			if (pid[i] == PID_REDIRECT_FAILED) {
+				pid[i] = -1;
+				continue;
+			}
+			if (pid[i] == -1) {
+				char *message = get_invalid_command_message(stages[i]->scmd);
+
+				/* As from the stage itself: into its pipe, if it has one. */
+				my_fwrite(message, my_strlen(message), 1,
+					  out_fd != -1 ? out_fd : STDOUT_FILENO);
+			}
+			continue;
+		}
 
-		status = parse_command(cmd2, level, father);
+		pid[i] = fork_shell(group, level);
+		if (pid[i] == -1)
+			break;
 
-		if (dup2(old_in, 0) == -1)
-			return -1;
-		close(old_in);
+		if (pid[i] == 0) {
+			if (in_fd != -1 && dup_fd(in_fd, 0) == -1)
+				shell_exit(-1);
+			if (out_fd != -1 && dup_fd(out_fd, 1) == -1)
+				shell_exit(-1);
+			close_pipes(fd, nr_pipes);
+
+			shell_exit(parse_command(stages[i], level, stages[i]->up));
+		}
+	}
+	close_pipes(fd, nr_pipes);
+
+	/* The stages are reaped in the order in which they finish. */
+	uint64_t wait_start = trace_start();
+	struct rusage ru;
+	int stage_status;
+	pid_t done;
+
+	if (started == nr_stages && pid[nr_stages - 1] == -1)
+		status = STATUS_NOT_STARTED;
+	while ((done = reaper_wait_any(group, &stage_status, &ru)) != -1) {
+		trace_end("wait", "pipe", level, wait_start);
+		wait_start = trace_start();
+
+		if (started == nr_stages && done == pid[nr_stages - 1])
+			status = stage_status;
+
+		for (size_t i = 0; acct != -1 && i < started; ++i)
+			if (pid[i] == done) {
+				account_child(acct, &total.start, &ru, stages[i]);
+				break;
+			}
+	}
+
+	if (acct != -1) {
+		char *text = get_command_text(c);
+
+		acct_end(acct, &total, text);
+		free(text);
 	}
 
 	return status;
 }
 
-char *get_invalid_command_message(simple_command_t *s)
+bool exec_in_place(command_t *c, int *status)
 {
-	if (!s)
-		return NULL;
+	if (!c || c->op != OP_NONE || !is_external_command(c->scmd))
+		return false;
 
-	size_t size = my_strlen("Execution failed for ''\n") + get_param_size(s->verb);
-	char *message = (char *)mmap(0, (size + 1) * sizeof(char), PROT_READ | PROT_WRITE,
-					MAP_PRIVATE | MAP_ANON, -1, 0);
+	simple_command_t *s = c->scmd;
+	char **params = command_argv(s);
+	const char *path = params ? path_cache_lookup(params[0]) : NULL;
+	struct redirect r;
 
-	if (!message)
-		return NULL;
-	message[0] = '\0';
-	my_strcat(message, "Execution failed for '");
+	if (!path)
+		return false;
 
-	word_t *verb = s->verb;
+	if (open_redirections(s, &r, -1, -1, 0) == -1) {
+		*status = -1;
+		return true;
+	}
 
-	while (verb) {
-		my_strcat(message, get_string(verb));
-		verb = verb->next_part;
+	if (redirect_apply(&r) != -1) {
+		trace_end("exec", params[0], 0, trace_start());
+		my_flush();
+		trace_flush();
+		execve(path, params, env_envp());
 	}
 
-	my_strcat(message, "'\n");
-	return message;
+	/* Run as usual, which reports the failure or runs a script with sh. */
+	redirect_restore(&r);
+	return false;
+}
+
+/*****
+ * Print the message of a command which could not be executed.
+ *
+ * @return the status of the command
+ *****/
+static int report_not_found(simple_command_t *s, int status)
+{
+	/* Processes return a u_int8 number, so -2 becomes 254. */
+	if (WEXITSTATUS(status) == 254) {
+		char *message = get_invalid_command_message(s);
+
+		my_fwrite(message, my_strlen(message), 1, 1);
+	}
+	return status;
 }
 
 /**
- * Parse and execute a command.
+ * Execute a command (see parse_command).
  *
  * When execut a simple command:
  *		status == 0 ==> command executed succesfully
  *		status == -1 (255) ==> something bad happend during command
  *		status == -2 (254) ==> invalid command (command not found)
  */
-int parse_command(command_t *c, int level, command_t *father)
+static int run_command(command_t *c, int level, command_t *father)
 {
 	if (!c)
 		return -1;
 
-	if (c->op == OP_NONE) {
-		int status = parse_simple(c->scmd, level, father);
-
-		/* Processes return a u_int8 number, so -2 becomes 254. */
-		if (WEXITSTATUS(status) == 254) {
-			char *message = get_invalid_command_message(c->scmd);
-
-			my_fwrite(message, my_strlen(message), 1, 1);
-		}
-
-		return status;
-	}
+	if (c->op == OP_NONE)
+		return report_not_found(c->scmd, parse_simple(c->scmd, level, father));
 
 	switch (c->op) {
 	case OP_SEQUENTIAL:
@@ -680,7 +967,7 @@ int parse_command(command_t *c, int level, command_t *father)
 
 	case OP_PARALLEL:
 		/* Execute the commands simultaneously. */
-		return run_in_parallel(c->cmd1, c->cmd2, level + 1, c);
+		return run_in_parallel(c, level + 1, father);
 
 	case OP_CONDITIONAL_NZERO:
 		/* Execute the second command only if the first one
@@ -698,11 +985,15 @@ int parse_command(command_t *c, int level, command_t *father)
 			return -1;
 		return parse_command(c->cmd2, level + 1, c);
 
+	case OP_BACKGROUND:
+		/* Do not wait for the command. */
+		return run_in_background(c->cmd1, level + 1);
+
 	case OP_PIPE:
-		/* Redirect the output of the first command to the
-		 * input of the second.
+		/* Redirect the output of each command to the
+		 * input of the next one.
 		 */
-		return run_on_pipe(c->cmd1, c->cmd2, level + 1, c);
+		return run_on_pipe(c, level + 1, father);
 
 	default:
 		return shell_exit(-1);
@@ -710,3 +1001,73 @@ int parse_command(command_t *c, int level, command_t *father)
 
 	return 0;
 }
+
+int parse_command(command_t *c, int level, command_t *father)
+{
+	uint64_t start = trace_start();
+	int status = run_command(c, level, father);
+
+	if (c)
+		trace_end("command", c->op == OP_NONE ? c->scmd->verb->string : op_name[c->op],
+			  level, start);
+	return status;
+}
+
+int run_plan(const struct plan *plan)
+{
+	int status = 0;
+	size_t pc = 0;
+
+	while (pc < plan->nr_insns) {
+		const struct plan_insn *insn = &plan->insns[pc++];
+		command_t *c = insn->cmd;
+		uint64_t start = trace_start();
+
+		switch (insn->op) {
+		case PLAN_EXTERNAL:
+			status = report_not_found(c->scmd, run_external_command(c->scmd, insn->level));
+			break;
+
+		case PLAN_BUILTIN:
+			status = run_builtin(insn->builtin, c->scmd, insn->level);
+			break;
+
+		case PLAN_ASSIGN:
+			set_env_var(c->scmd->verb);
+			status = 0;
+			break;
+
+		case PLAN_SIMPLE:
+			status = report_not_found(c->scmd, parse_simple(c->scmd, insn->level, c->up));
+			break;
+
+		case PLAN_PIPE:
+			status = run_on_pipe(c, insn->level, c->up);
+			break;
+
+		case PLAN_PARALLEL:
+			status = run_in_parallel(c, insn->level, c->up);
+			break;
+
+		case PLAN_BACKGROUND:
+			status = run_in_background(c, insn->level);
+			break;
+
+		case PLAN_SET:
+			status = insn->value;
+			continue;
+
+		case PLAN_BRANCH_ZERO:
+		case PLAN_BRANCH_NONZERO:
+			if ((status == 0) == (insn->op == PLAN_BRANCH_ZERO)) {
+				status = insn->value;
+				pc = insn->target;
+			}
+			continue;
+		}
+
+		trace_end("command", c->op == OP_NONE ? c->scmd->verb->string : op_name[c->op],
+			  insn->level, start);
+	}
+	return status;
+}
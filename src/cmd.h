@@ -4,12 +4,52 @@
 #define _CMD_H
 
 #include "../util/parser/parser.h"
+#include <stdbool.h>
 
 #define SHELL_EXIT -100
 
+struct plan;
+
 /**
  * Parse and execute a command.
  */
 int parse_command(command_t *cmd, int level, command_t *father);
 
+/**
+ * Execute the plan of a command line (see plan.h). It does what
+ * parse_command does for the parse tree of the line.
+ *
+ * @return the status of the line
+ */
+int run_plan(const struct plan *plan);
+
+/**
+ * Set how many commands of a parallel group may run at the same time
+ * (the -j option). Without it, MINISHELL_JOBS is used; if it is not set
+ * either, there is no limit.
+ */
+void set_job_slots(int slots);
+
+/**
+ * Build the argv of a command, after the expansion of the environment
+ * variables. The array and the strings are allocated in the arena.
+ *
+ * @param verb special list which conatains the verb of the commnad
+ * @param param special list which conatains the params of the verb
+ * @return an arrays of strings which represent the parameters of a command
+ *		   NULL, if something bad happened
+ */
+char **get_params(const word_t *verb, word_t *param);
+
+/**
+ * Replace the current process with cmd, if it is a single external
+ * command. The last command of a script uses it to avoid a fork.
+ *
+ * @param status the status of cmd, if its redirections failed
+ * @return true, if the redirections of cmd failed (it was reported)
+ *		   false, if cmd could not replace the process; nothing was done
+ *		   and the caller runs it as usual
+ */
+bool exec_in_place(command_t *cmd, int *status);
+
 #endif /* _CMD_H */
@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "env.h"
+#include "my_string.h"
+#include "stats.h"
+
+#define MIN_CAPACITY		64
+
+struct env_entry {
+	/* "name=value", allocated with malloc; NULL for an empty slot. */
+	char *var;
+	size_t name_len;
+	/* Number of bytes allocated for var. */
+	size_t size;
+	unsigned int hash;
+};
+
+/* Open addressing table, with linear probing; capacity is a power of 2. */
+static struct env_entry *table;
+static size_t capacity;
+static size_t nr_vars;
+
+static unsigned long generation;
+
+/* The envp array and the generation for which it was built. */
+static char **envp;
+static size_t envp_capacity;
+static unsigned long envp_generation = -1;
+
+/*****
+ * FNV-1a hash of the first len characters of a name.
+ *****/
+static unsigned int hash_name(const char *name, size_t len)
+{
+	unsigned int hash = 2166136261u;
+
+	for (size_t i = 0; i < len; ++i) {
+		hash ^= (unsigned char)name[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*****
+ * @return the slot of the variable with the given name, if it exists
+ *		   the empty slot where it should be added, else
+ *****/
+static struct env_entry *find_slot(const char *name, size_t len, unsigned int hash)
+{
+	size_t i = hash & (capacity - 1);
+
+	while (table[i].var) {
+		if (table[i].hash == hash && table[i].name_len == len &&
+		    !memcmp(table[i].var, name, len))
+			break;
+		i = (i + 1) & (capacity - 1);
+	}
+	return &table[i];
+}
+
+/*****
+ * Make room for one more variable, keeping the table at most half full.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ *****/
+static int ensure_capacity(void)
+{
+	if (2 * (nr_vars + 1) <= capacity)
+		return 0;
+
+	size_t old_capacity = capacity;
+	struct env_entry *old_table = table;
+
+	capacity = capacity ? 2 * capacity : MIN_CAPACITY;
+	table = calloc(capacity, sizeof(*table));
+	if (!table) {
+		table = old_table;
+		capacity = old_capacity;
+		return -1;
+	}
+
+	for (size_t i = 0; i < old_capacity; ++i)
+		if (old_table[i].var)
+			*find_slot(old_table[i].var, old_table[i].name_len,
+				   old_table[i].hash) = old_table[i];
+	free(old_table);
+	return 0;
+}
+
+/*****
+ * Save a "name=value" string in its slot.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ *****/
+static int store(const char *name, size_t name_len, const char *value)
+{
+	if (ensure_capacity() == -1)
+		return -1;
+
+	unsigned int hash = hash_name(name, name_len);
+	struct env_entry *entry = find_slot(name, name_len, hash);
+	size_t size = name_len + my_strlen(value) + 2;
+
+	if (entry->size < size) {
+		char *var = realloc(entry->var, size);
+
+		if (!var)
+			return -1;
+		if (!entry->var)
+			nr_vars++;
+		entry->var = var;
+		entry->size = size;
+	}
+
+	memcpy(entry->var, name, name_len);
+	entry->var[name_len] = '=';
+	memcpy(entry->var + name_len + 1, value, size - name_len - 1);
+	entry->name_len = name_len;
+	entry->hash = hash;
+
+	generation++;
+	return 0;
+}
+
+/*****
+ * Import the environment inherited by the shell, the first time it is
+ * needed.
+ *****/
+static void env_init(void)
+{
+	extern char **environ;
+	static int initialized;
+
+	if (initialized)
+		return;
+	initialized = 1;
+
+	for (size_t i = 0; environ[i]; ++i) {
+		const char *eq = strchr(environ[i], '=');
+
+		if (eq)
+			store(environ[i], eq - environ[i], eq + 1);
+	}
+}
+
+const char *env_get(const char *name)
+{
+	if (!name)
+		return NULL;
+
+	stat_inc(STAT_ENV_LOOKUPS);
+
+	env_init();
+	if (!capacity)
+		return NULL;
+
+	size_t len = my_strlen(name);
+	struct env_entry *entry = find_slot(name, len, hash_name(name, len));
+
+	return entry->var ? entry->var + len + 1 : NULL;
+}
+
+int env_set(const char *name, const char *value)
+{
+	if (!name || !name[0])
+		return -1;
+
+	env_init();
+	return store(name, my_strlen(name), value ? value : "");
+}
+
+unsigned long env_generation(void)
+{
+	env_init();
+	return generation;
+}
+
+char **env_envp(void)
+{
+	env_init();
+	if (envp && envp_generation == generation)
+		return envp;
+
+	if (envp_capacity < nr_vars + 1) {
+		char **new_envp = realloc(envp, (nr_vars + 1) * sizeof(char *));
+
+		if (!new_envp)
+			return NULL;
+		envp = new_envp;
+		envp_capacity = nr_vars + 1;
+	}
+
+	size_t pos = 0;
+
+	for (size_t i = 0; i < capacity; ++i)
+		if (table[i].var)
+			envp[pos++] = table[i].var;
+	envp[pos] = NULL;
+
+	envp_generation = generation;
+	return envp;
+}
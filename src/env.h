@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _ENV_H
+#define _ENV_H
+
+/*
+ * The environment of the shell. It is imported from environ the first
+ * time it is used and then kept in a hash table, so a lookup does not
+ * depend on the number of variables. Every change bumps a generation
+ * counter; the envp array given to exec is rebuilt only after a change.
+ */
+
+/**
+ * @param name name of the variable
+ * @return the value of the variable
+ *		   NULL, if there is no such variable
+ */
+const char *env_get(const char *name);
+
+/**
+ * Set or add a variable. If the variable already exists, its value is
+ * changed in place.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ */
+int env_set(const char *name, const char *value);
+
+/**
+ * @return the number of changes made to the environment so far
+ */
+unsigned long env_generation(void);
+
+/**
+ * @return a NULL terminated array of "name=value" strings, to be given
+ *		   to exec; it stays valid until the next change
+ *		   NULL, if the array could not be built
+ */
+char **env_envp(void);
+
+#endif /* _ENV_H */
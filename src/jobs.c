@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobs.h"
+#include "reaper.h"
+#include "utils.h"
+#include "my_string.h"
+#include "my_stdio.h"
+
+struct job {
+	int id;
+	pid_t pid;
+	int done;
+	int status;
+	/* The command, as it would be typed. */
+	char *text;
+};
+
+static struct job *jobs;
+static size_t nr_jobs;
+static size_t jobs_size;
+
+/* 0, if it was not created yet. */
+static int group;
+
+int jobs_group(void)
+{
+	if (!group)
+		group = reaper_new_group();
+	return group;
+}
+
+int jobs_add(pid_t pid, command_t *c)
+{
+	if (nr_jobs == jobs_size) {
+		size_t size = jobs_size ? 2 * jobs_size : 8;
+		struct job *new_jobs = realloc(jobs, size * sizeof(*jobs));
+
+		if (!new_jobs)
+			return -1;
+		jobs = new_jobs;
+		jobs_size = size;
+	}
+
+	char *text = get_command_text(c);
+
+	if (!text)
+		return -1;
+
+	struct job *job = &jobs[nr_jobs];
+
+	/* The ids are reused only when the jobs with greater ids are gone. */
+	job->id = nr_jobs ? jobs[nr_jobs - 1].id + 1 : 1;
+	job->pid = pid;
+	job->done = 0;
+	job->text = text;
+	nr_jobs++;
+
+	if (isatty(STDERR_FILENO)) {
+		char line[64];
+		int n = snprintf(line, sizeof(line), "[%d] %d\n", job->id, (int)pid);
+
+		my_fwrite(line, n, 1, STDERR_FILENO);
+	}
+	return job->id;
+}
+
+/*****
+ * Mark the jobs which finished, without blocking.
+ *****/
+static void update_jobs(void)
+{
+	int status;
+	pid_t pid;
+
+	if (!group)
+		return;
+
+	while ((pid = reaper_poll(group, &status, NULL)) != -1)
+		for (size_t i = 0; i < nr_jobs; ++i)
+			if (jobs[i].pid == pid) {
+				jobs[i].done = 1;
+				jobs[i].status = status;
+				break;
+			}
+}
+
+/*****
+ * Remove a job from the table, keeping the others in order.
+ *****/
+static void remove_job(size_t i)
+{
+	free(jobs[i].text);
+	memmove(&jobs[i], &jobs[i + 1], (nr_jobs - i - 1) * sizeof(*jobs));
+	nr_jobs--;
+}
+
+/*****
+ * Print a job like "[1] Done	sleep 1".
+ *****/
+static void print_job(int fd, struct job *job)
+{
+	char state[64];
+	char line[4096];
+	int len;
+
+	if (!job->done)
+		snprintf(state, sizeof(state), "Running");
+	else if (WIFSIGNALED(job->status))
+		snprintf(state, sizeof(state), "%s", strsignal(WTERMSIG(job->status)));
+	else if (WEXITSTATUS(job->status))
+		snprintf(state, sizeof(state), "Exit %d", WEXITSTATUS(job->status));
+	else
+		snprintf(state, sizeof(state), "Done");
+
+	len = snprintf(line, sizeof(line), "[%d] %-12s%s\n", job->id, state, job->text);
+	if (len >= (int)sizeof(line))
+		len = sizeof(line) - 1;
+	my_fwrite(line, len, 1, fd);
+}
+
+void jobs_notify(int fd)
+{
+	update_jobs();
+
+	for (size_t i = 0; i < nr_jobs;)
+		if (jobs[i].done) {
+			if (fd != -1)
+				print_job(fd, &jobs[i]);
+			remove_job(i);
+		} else {
+			i++;
+		}
+}
+
+int jobs_print(int fd)
+{
+	update_jobs();
+
+	for (size_t i = 0; i < nr_jobs; ++i)
+		print_job(fd, &jobs[i]);
+
+	/* The finished jobs were reported. */
+	for (size_t i = 0; i < nr_jobs;)
+		if (jobs[i].done)
+			remove_job(i);
+		else
+			i++;
+	return 0;
+}
+
+/*****
+ * Wait for a job, if it is still running.
+ *****/
+static void wait_job(struct job *job)
+{
+	if (!job->done && reaper_wait(job->pid, &job->status, NULL) != -1)
+		job->done = 1;
+}
+
+int jobs_wait(const char *id)
+{
+	if (!id) {
+		while (nr_jobs) {
+			wait_job(&jobs[0]);
+			remove_job(0);
+		}
+		return 0;
+	}
+
+	char *end;
+	long value = strtol(id[0] == '%' ? id + 1 : id, &end, 10);
+
+	for (size_t i = 0; *end == '\0' && end != id && i < nr_jobs; ++i) {
+		if (id[0] == '%' ? jobs[i].id != value : jobs[i].pid != value)
+			continue;
+
+		wait_job(&jobs[i]);
+
+		int status = jobs[i].done ? jobs[i].status : -1;
+
+		remove_job(i);
+		return WIFEXITED(status) && !WEXITSTATUS(status) ? 0 : -1;
+	}
+
+	my_fwrite("mini-shell: wait: ", 18, 1, STDERR_FILENO);
+	my_fwrite(id, my_strlen(id), 1, STDERR_FILENO);
+	my_fwrite(": no such job\n", 14, 1, STDERR_FILENO);
+	return -1;
+}
+
+void jobs_forget_all(void)
+{
+	for (size_t i = 0; i < nr_jobs; ++i)
+		free(jobs[i].text);
+	nr_jobs = 0;
+}
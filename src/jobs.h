@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _JOBS_H
+#define _JOBS_H
+
+#include <sys/types.h>
+
+#include "../util/parser/parser.h"
+
+/*
+ * The table of the background jobs (commands ended by '&'). Every job is
+ * a single child of the shell, registered with the reaper in the group
+ * returned by jobs_group(). Finished jobs stay in the table until they
+ * are reported by jobs_notify() or by the jobs/wait builtins.
+ */
+
+/**
+ * @return the reaper group of the background jobs
+ */
+int jobs_group(void);
+
+/**
+ * Add a started job to the table.
+ *
+ * @param pid the pid of the child which runs the job
+ * @param c the command run by the job (it is copied as text)
+ * @return the id of the job
+ *		  -1, if the table is full
+ */
+int jobs_add(pid_t pid, command_t *c);
+
+/**
+ * Report the jobs which finished since the last call, without blocking,
+ * and remove them from the table.
+ *
+ * @param fd file in which the jobs are reported (-1, to remove them
+ *			 without a report)
+ */
+void jobs_notify(int fd);
+
+/**
+ * Internal jobs command: print all the jobs.
+ */
+int jobs_print(int fd);
+
+/**
+ * Internal wait command.
+ *
+ * @param id "%N" for the job N, a pid, or NULL for all the jobs
+ * @return 0, if the job (or all the jobs) exited with 0
+ *		  -1, else
+ */
+int jobs_wait(const char *id);
+
+/**
+ * Forget all the jobs. It must be called in a forked child.
+ */
+void jobs_forget_all(void);
+
+#endif /* _JOBS_H */
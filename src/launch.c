@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+
+#include <errno.h>
+#include <spawn.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "launch.h"
+#include "env.h"
+#include "my_stdio.h"
+#include "stats.h"
+
+/*****
+ * Add the file actions which set up the standard streams of a command.
+ * The actions are executed by the child, in order, before the exec; a
+ * stream which already is the right fd needs no action. A stream which
+ * is a copy of another standard stream ("2>&1 >out") is set first, before
+ * that stream is replaced.
+ *
+ * @param fa the file actions that will be given to posix_spawn
+ * @param fd the fds which become the standard streams (-1: inherited)
+ * @return 0, if the function finished successfully
+ *		   error number, else
+ *****/
+static int add_redirections(posix_spawn_file_actions_t *fa, const int fd[3])
+{
+	for (int copies = 1; copies >= 0; --copies)
+		for (int i = 0; i < 3; ++i) {
+			if (fd[i] == -1 || fd[i] == i || (fd[i] < 3) != copies)
+				continue;
+
+			stat_inc(STAT_DUP2);
+			int rc = posix_spawn_file_actions_adddup2(fa, fd[i], i);
+
+			if (rc)
+				return rc;
+		}
+	return 0;
+}
+
+/*****
+ * Spawn an executable which is not a binary and has no "#!" line with
+ * /bin/sh, as execvp() does: sh gets the path and the arguments.
+ *
+ * @return 0, if the function finished successfully
+ *		   error number, else
+ *****/
+static int spawn_script(pid_t *pid, const char *path, char **argv,
+			const posix_spawn_file_actions_t *fa,
+			const posix_spawnattr_t *attr, char **envp)
+{
+	size_t argc = 0;
+	char **sh_argv;
+	int rc;
+
+	while (argv[argc])
+		argc++;
+
+	/* "/bin/sh", path, argv[1..argc - 1], NULL */
+	sh_argv = malloc((argc + 2) * sizeof(char *));
+	if (!sh_argv)
+		return ENOMEM;
+
+	sh_argv[0] = "/bin/sh";
+	sh_argv[1] = (char *)path;
+	for (size_t i = 1; i <= argc; ++i)
+		sh_argv[i + 1] = argv[i];
+
+	rc = posix_spawn(pid, "/bin/sh", fa, attr, sh_argv, envp);
+	free(sh_argv);
+	return rc;
+}
+
+pid_t spawn_command(const char *path, char **argv, const int fd[3])
+{
+	char **envp = env_envp();
+	posix_spawn_file_actions_t fa;
+	posix_spawnattr_t attr;
+	pid_t pid;
+	int rc;
+
+	if (!envp) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	rc = posix_spawn_file_actions_init(&fa);
+	if (rc) {
+		errno = rc;
+		return -1;
+	}
+
+	rc = posix_spawnattr_init(&attr);
+	if (rc) {
+		posix_spawn_file_actions_destroy(&fa);
+		errno = rc;
+		return -1;
+	}
+
+	/*
+	 * glibc already starts the child with clone(CLONE_VM | CLONE_VFORK);
+	 * the flag only matters for older libraries, which would fork.
+	 */
+	rc = posix_spawnattr_setflags(&attr, POSIX_SPAWN_USEVFORK);
+	if (!rc)
+		rc = add_redirections(&fa, fd);
+	if (!rc) {
+		/* The command writes after what the shell printed. */
+		my_flush();
+		rc = posix_spawn(&pid, path, &fa, &attr, argv, envp);
+		if (rc == ENOEXEC && argv[0])
+			rc = spawn_script(&pid, path, argv, &fa, &attr, envp);
+	}
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&fa);
+
+	if (rc) {
+		errno = rc;
+		return -1;
+	}
+	return pid;
+}
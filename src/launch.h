@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _LAUNCH_H
+#define _LAUNCH_H
+
+#include <sys/types.h>
+
+/**
+ * Start an external command without copying the shell's page tables.
+ * The executable is given by path; PATH is not searched.
+ *
+ * The fds in fd (e.g. the files of the redirections or the ends of a
+ * pipe, see redirect.h) become the stdin, stdout and stderr of the
+ * command; -1 means that the stream is inherited. They are given to the
+ * child as spawn file actions, so the shell never touches its own
+ * standard streams.
+ *
+ * As with execvp(), an executable which is neither a binary nor a script
+ * with a "#!" line is run by /bin/sh.
+ *
+ * @return pid of the new process, if the command was started
+ *		   -1, else (errno tells why)
+ */
+pid_t spawn_command(const char *path, char **argv, const int fd[3]);
+
+#endif /* _LAUNCH_H */
@@ -1,86 +1,207 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "../util/parser/parser.h"
 #include "cmd.h"
+#include "plan.h"
+#include "jobs.h"
+#include "trace.h"
+#include "stats.h"
 #include "utils.h"
+#include "arena.h"
+#include "my_stdio.h"
 
 #define PROMPT             "> "
-#define CHUNK_SIZE         1024
+#define LINE_SIZE          128
+/* A terminal gives a line at a time; files and pipes are read in big blocks. */
+#define READ_SIZE          (64 * 1024)
+#define SCRIPT_READ_SIZE   (1024 * 1024)
 
 
+/* Buffered input of the shell: the bytes in [start, end) are not used yet. */
+static struct {
+	int fd;
+	char *buff;
+	size_t size;
+	size_t start;
+	size_t end;
+	bool eof;
+} input = { .fd = STDIN_FILENO };
+
+/* Print the plan of every line on stderr (--dump-plan). */
+static bool dump_plan;
+
 void parse_error(const char *str, const int where)
 {
-	fprintf(stderr, "Parse error near %d: %s\n", where, str);
+	char message[256];
+	int len = snprintf(message, sizeof(message), "Parse error near %d: %s\n", where, str);
+
+	if (len >= (int)sizeof(message))
+		len = sizeof(message) - 1;
+	my_fwrite(message, len, 1, STDERR_FILENO);
 }
 
 /**
- * Readline from mini-shell.
+ * Read the next block of the input into the buffer.
+ *
+ * @return number of bytes read (0 at the end of the input)
  */
-static char *read_line(void)
+static ssize_t fill_input(void)
 {
-	char *line = NULL;
-	int line_length = 0;
+	ssize_t n;
 
-	char chunk[CHUNK_SIZE];
-	int chunk_length;
+	if (!input.buff) {
+		input.buff = malloc(input.size);
+		DIE(input.buff == NULL, "Error allocating input buffer");
+	}
 
-	char *rc;
+	/* The shell may block here: what it printed must be seen. */
+	my_flush();
+	do {
+		n = read(input.fd, input.buff, input.size);
+	} while (n < 0 && errno == EINTR);
 
-	int endline = 0;
+	input.start = 0;
+	input.end = n > 0 ? n : 0;
+	input.eof = n <= 0;
+	return input.end;
+}
 
-	while (!endline) {
-		rc = fgets(chunk, CHUNK_SIZE, stdin);
-		if (rc == NULL)
+/**
+ * Readline from mini-shell. The line grows geometrically and every byte
+ * is copied only once, so long lines are read in linear time.
+ *
+ * @return the line, without the end of line (allocated with malloc)
+ *		   NULL, at the end of the input
+ */
+static char *read_line(void)
+{
+	char *line = NULL;
+	size_t line_length = 0;
+	size_t line_size = 0;
+
+	while (1) {
+		if (input.start == input.end && (input.eof || !fill_input()))
 			break;
 
-		chunk_length = strlen(chunk);
-		if (chunk[chunk_length - 1] == '\n') {
-			if (chunk_length > 1 && chunk[chunk_length - 2] == '\r')
-				/* Windows */
-				chunk[chunk_length - 2] = 0;
-			else
-				chunk[chunk_length - 1] = 0;
-			endline = 1;
-		}
+		char *chunk = input.buff + input.start;
+		size_t chunk_length = input.end - input.start;
+		char *newline = memchr(chunk, '\n', chunk_length);
 
-		line = realloc(line, line_length + CHUNK_SIZE);
-		DIE(line == NULL, "Error allocating command line");
+		if (newline)
+			chunk_length = newline - chunk;
+
+		if (line_length + chunk_length + 1 > line_size) {
+			line_size = line_size ? 2 * line_size : LINE_SIZE;
+			while (line_length + chunk_length + 1 > line_size)
+				line_size *= 2;
+			line = realloc(line, line_size);
+			DIE(line == NULL, "Error allocating command line");
+		}
 
-		line[line_length] = '\0';
-		strcat(line, chunk);
+		memcpy(line + line_length, chunk, chunk_length);
+		line_length += chunk_length;
+		input.start += chunk_length;
 
-		line_length += CHUNK_SIZE;
+		if (newline) {
+			input.start++;
+			break;
+		}
 	}
 
+	if (!line)
+		return NULL;
+
+	/* Windows */
+	if (line_length && line[line_length - 1] == '\r')
+		line_length--;
+	line[line_length] = '\0';
+
 	return line;
 }
 
-static void start_shell(void)
+/**
+ * Run the commands from the input. A prompt is printed before each line,
+ * except when the commands come from a script given as argument.
+ */
+static void start_shell(bool script)
 {
-	char *line;
+	char *line, *next_line = NULL;
 	command_t *root;
+	bool interactive = isatty(input.fd);
+	uint64_t last_line = 0;
 
 	int ret;
 
 	for (;;) {
-		printf(PROMPT);
-		fflush(stdout);
+		/*
+		 * Remove the background jobs which finished. Only a user at a
+		 * terminal is told about them.
+		 */
+		jobs_notify(interactive ? STDERR_FILENO : -1);
+
+		if (!script) {
+			my_fwrite(PROMPT, sizeof(PROMPT) - 1, 1, STDOUT_FILENO);
+			my_flush();
+		}
 		ret = 0;
 
+		/* Time spent on the previous line, prompt included. */
+		uint64_t now = stat_now();
+
+		if (last_line)
+			stat_record(STAT_PROMPT_LATENCY, now - last_line);
+		last_line = now;
+
 		root = NULL;
-		line = read_line();
+		line = next_line ? next_line : read_line();
 		if (line == NULL)
 			return;
-		parse_line(line, &root);
 
-		if (root != NULL)
+		/* A line which ran before is not parsed again. */
+		struct plan *plan = plan_find(line);
+
+		if (!plan) {
+			uint64_t start = trace_start();
+			uint64_t parse_start = stat_now();
+
+			parse_line(line, &root);
+			stat_add(STAT_PARSE_NS, stat_now() - parse_start);
+			trace_end("parse", line, 0, start);
+
+			if (root != NULL)
+				plan = plan_compile(line, root);
+		}
+		if (plan) {
+			root = plan->root;
+			if (dump_plan)
+				plan_dump(plan, STDERR_FILENO);
+		}
+
+		/*
+		 * A script given as argument is read one line ahead, so that its
+		 * last command can take over the shell process instead of being
+		 * forked. A file is never waited for; a pipe or a terminal may
+		 * be, so their lines run as soon as they are read.
+		 */
+		next_line = script ? read_line() : NULL;
+
+		bool done = script && next_line == NULL && exec_in_place(root, &ret);
+
+		if (!done && plan)
+			ret = run_plan(plan);
+		else if (!done && root != NULL)
 			ret = parse_command(root, 0, NULL);
 
 		free_parse_memory();
+		arena_reset();
 		free(line);
 
 		if (ret == SHELL_EXIT)
@@ -88,9 +209,43 @@ static void start_shell(void)
 	}
 }
 
-int main(void)
+int main(int argc, char *argv[])
 {
-	start_shell();
+	static const struct option options[] = {
+		{ "dump-plan", no_argument, NULL, 'p' },
+		{ NULL, 0, NULL, 0 }
+	};
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "j:", options, NULL)) != -1) {
+		if (opt == 'p') {
+			dump_plan = true;
+			continue;
+		}
+		if (opt != 'j' || atoi(optarg) <= 0) {
+			fprintf(stderr, "usage: %s [-j jobs] [--dump-plan] [script]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+		set_job_slots(atoi(optarg));
+	}
+
+	bool script = optind < argc;
+
+	input.size = READ_SIZE;
+	if (script) {
+		/* The commands of the script must not inherit it. */
+		input.fd = open(argv[optind], O_RDONLY | O_CLOEXEC);
+		if (input.fd == -1) {
+			fprintf(stderr, "mini-shell: %s: %s\n", argv[optind], strerror(errno));
+			return 127;
+		}
+		input.size = SCRIPT_READ_SIZE;
+	}
+
+	trace_init();
+	start_shell(script);
+	my_flush();
+	trace_flush();
 
 	return EXIT_SUCCESS;
 }
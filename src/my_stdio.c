@@ -1,23 +1,214 @@
 // SPDX-License-Identifier: BSD-3-Clause
 
+#define _GNU_SOURCE
+
 #include <sys/types.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "my_stdio.h"
+#include "pipes.h"
+#include "stats.h"
+
+/* Number of bytes asked from the kernel at once when copying. */
+#define COPY_CHUNK		(1 << 20)
+#define COPY_BUFFER_SIZE	(64 * 1024)
+#define OUT_BUFFER_SIZE		(16 * 1024)
+/* Buffers given to one writev by my_fwritev(); longer lists are split. */
+#define MAX_PIECES		16
+
+/*
+ * The output kept for stdout or stderr. There is a single buffer, for the
+ * stream written last: a write on the other stream flushes it first, so
+ * the messages keep their order when both streams are the same file.
+ */
+static struct {
+	char data[OUT_BUFFER_SIZE];
+	size_t len;
+	int fd;
+} out = { .fd = -1 };
+
+/*****
+ * Write all the buffers, after partial writes and signals too.
+ *
+ * @param iov the buffers; the array is changed
+ * @return 0, if the function finished successfully
+ *		   -1, else
+ *****/
+static int write_all(struct iovec *iov, int iovcnt, int fd)
+{
+	while (iovcnt) {
+		if (!iov->iov_len) {
+			iov++;
+			iovcnt--;
+			continue;
+		}
+
+		pipe_before_write(fd);
+		stat_inc(STAT_WRITES);
+
+		ssize_t n = writev(fd, iov, iovcnt);
+
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (; iovcnt && (size_t)n >= iov->iov_len; iov++, iovcnt--)
+			n -= iov->iov_len;
+		if (n) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return 0;
+}
+
+int my_flush(void)
+{
+	struct iovec iov = { .iov_base = out.data, .iov_len = out.len };
+
+	if (!out.len)
+		return 0;
+	out.len = 0;
+	return write_all(&iov, 1, out.fd);
+}
+
+ssize_t my_fwritev(const struct iovec *iov, int iovcnt, int fd)
+{
+	struct iovec pieces[MAX_PIECES + 1];
+	size_t total = 0;
+	int nr_pieces = 0;
+
+	for (int i = 0; i < iovcnt; ++i)
+		total += iov[i].iov_len;
+
+	if (fd == STDOUT_FILENO || fd == STDERR_FILENO) {
+		if (out.fd != fd && my_flush() == -1)
+			return -1;
+		out.fd = fd;
+
+		if (out.len + total <= sizeof(out.data)) {
+			for (int i = 0; i < iovcnt; ++i) {
+				memcpy(out.data + out.len, iov[i].iov_base, iov[i].iov_len);
+				out.len += iov[i].iov_len;
+			}
+			return total;
+		}
+
+		/* What is buffered leaves with the new data, in the same writev. */
+		pieces[nr_pieces].iov_base = out.data;
+		pieces[nr_pieces++].iov_len = out.len;
+		out.len = 0;
+	}
+
+	for (int i = 0; i < iovcnt; ++i) {
+		pieces[nr_pieces++] = iov[i];
+		if (nr_pieces == MAX_PIECES + 1) {
+			if (write_all(pieces, nr_pieces, fd) == -1)
+				return -1;
+			nr_pieces = 0;
+		}
+	}
+	if (nr_pieces && write_all(pieces, nr_pieces, fd) == -1)
+		return -1;
+
+	return total;
+}
 
 int my_fwrite(const void *buff, size_t size, size_t nitems, int fd)
 {
-	size_t total_bytes = size * nitems;
-	size_t total_writen_bytes = 0;
+	struct iovec iov = { .iov_base = (void *)buff, .iov_len = size * nitems };
+
+	return my_fwritev(&iov, 1, fd);
+}
+
+/*****
+ * Move bytes from in_fd to out_fd inside the kernel.
+ *
+ * @param method 0 ==> splice (one of the fds must be a pipe)
+ *				 1 ==> copy_file_range (both fds must be regular files)
+ *				 2 ==> sendfile (in_fd must support mmap)
+ * @return number of bytes moved (0 at the end of the input)
+ *		   -1, if the kernel refused the copy or an error occurred
+ *****/
+static ssize_t kernel_copy(int method, int in_fd, int out_fd)
+{
+	switch (method) {
+	case 0:
+		return splice(in_fd, NULL, out_fd, NULL, COPY_CHUNK,
+			      SPLICE_F_MOVE | SPLICE_F_MORE);
+	case 1:
+		return copy_file_range(in_fd, NULL, out_fd, NULL, COPY_CHUNK, 0);
+	case 2:
+		return sendfile(out_fd, in_fd, NULL, COPY_CHUNK);
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+}
+
+/*****
+ * @return true, if the error means that the kernel can not copy between
+ *		   these two files with the method that was tried
+ *****/
+static int copy_refused(int err)
+{
+	return err == EINVAL || err == ENOSYS || err == EXDEV ||
+	       err == EOPNOTSUPP || err == EBADF || err == ESPIPE;
+}
+
+ssize_t my_fcopy(int in_fd, int out_fd)
+{
+	ssize_t total = 0;
+
+	/* The data copied by the kernel must come after what is buffered. */
+	if (my_flush() == -1)
+		return -1;
+
+	for (int method = 0; method < 3; ++method) {
+		ssize_t n;
+
+		for (;;) {
+			pipe_before_write(out_fd);
+			n = kernel_copy(method, in_fd, out_fd);
+			if (n <= 0)
+				break;
+			total += n;
+		}
+
+		if (n == 0)
+			return total;
+		if (errno == EINTR) {
+			method--;
+			continue;
+		}
+		/* Data already moved means that the error is a real one. */
+		if (total || !copy_refused(errno))
+			return -1;
+	}
+
+	char buff[COPY_BUFFER_SIZE];
+	ssize_t n;
 
-	while (total_bytes != total_writen_bytes) {
-		size_t remained_bytes = total_bytes - total_writen_bytes;
-		size_t written_bytes = write(fd, buff + total_writen_bytes, remained_bytes);
+	while ((n = read(in_fd, buff, sizeof(buff))) != 0) {
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		struct iovec iov = { .iov_base = buff, .iov_len = n };
 
-		if (written_bytes < 0)
-			return written_bytes;
-		total_writen_bytes += written_bytes;
+		if (write_all(&iov, 1, out_fd) == -1)
+			return -1;
+		total += n;
 	}
 
-	return total_writen_bytes;
+	return total;
 }
@@ -3,6 +3,55 @@
 #ifndef _MY_STDIO_H
 #define _MY_STDIO_H
 
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/*
+ * What the shell itself prints on stdout and stderr (builtins, messages,
+ * the prompt) is buffered, so many small outputs leave in one write. The
+ * buffer must be empty whenever another process may write on the same
+ * files or the fds change: my_flush() is called before fork, spawn, exec
+ * and dup2 of a standard stream, before the shell blocks (reading the
+ * input, waiting for children) and before it exits.
+ *
+ * The other fds (trace, accounting, files given by the caller) are not
+ * buffered.
+ */
+
+/**
+ * Write the whole buffer to a file; on stdout and stderr, it may be kept
+ * in the buffer of the shell until my_flush().
+ *
+ * @return number of bytes written
+ *		   -1, if an error occurred
+ */
 int my_fwrite(const void *buff, size_t size, size_t nitems, int fd);
 
+/**
+ * Write several buffers to a file, in order. What is buffered for the
+ * file leaves with them, in a single writev.
+ *
+ * @return number of bytes of the buffers written
+ *		   -1, if an error occurred
+ */
+ssize_t my_fwritev(const struct iovec *iov, int iovcnt, int fd);
+
+/**
+ * Write what is buffered for stdout and stderr.
+ *
+ * @return 0, if the function finished successfully
+ *		   -1, else
+ */
+int my_flush(void);
+
+/**
+ * Copy everything from in_fd to out_fd. The data is moved inside the
+ * kernel (splice, copy_file_range or sendfile) when possible; read and
+ * write are used only when the kernel refuses all of them.
+ *
+ * @return number of bytes copied
+ *		   -1, if an error occurred
+ */
+ssize_t my_fcopy(int in_fd, int out_fd);
+
 #endif /* _MY_STDIO_H */
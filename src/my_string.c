@@ -2,18 +2,14 @@
 
 #include <sys/types.h>
 
+#include <string.h>
+
 #include "my_string.h"
 
 size_t my_strlen(const char *s)
 {
-	if (!s)
-		return 0;
-
-	size_t cnt = 0;
-
-	while (s[cnt])
-		cnt++;
-	return cnt;
+	/* The strlen() of the C library is vectorized, and known by the checkers. */
+	return s ? strlen(s) : 0;
 }
 
 int my_strcmp(const char *s1, const char *s2)
@@ -28,22 +24,40 @@ int my_strcmp(const char *s1, const char *s2)
 
 void my_strcat(char *dst, const char *src)
 {
-	size_t i = 0;
+	my_strcpy(dst + my_strlen(dst), src);
+}
 
-	while (dst[i])
-		i++;
+void my_strcpy(char *dst, const char *src)
+{
+	/* The null byte is copied too. */
+	memcpy(dst, src, my_strlen(src) + 1);
+}
 
-	size_t j = 0;
+void my_str_init(struct my_str *str, char *buff, size_t size)
+{
+	str->buff = buff;
+	str->len = 0;
+	str->size = size;
+	buff[0] = '\0';
+}
+
+int my_str_append_n(struct my_str *str, const char *s, size_t n)
+{
+	size_t room = str->size - str->len - 1;
+	int ret = 0;
 
-	while (src[j]) {
-		dst[i + j] = src[j];
-		j++;
+	if (n > room) {
+		n = room;
+		ret = -1;
 	}
-	dst[i + j] = '\0';
+
+	memcpy(str->buff + str->len, s, n);
+	str->len += n;
+	str->buff[str->len] = '\0';
+	return ret;
 }
 
-void my_strcpy(char *dst, const char *src)
+int my_str_append(struct my_str *str, const char *s)
 {
-	for (size_t i = 0; src[i]; ++i)
-		dst[i] = src[i];
+	return my_str_append_n(str, s ? s : "", my_strlen(s));
 }
@@ -3,9 +3,48 @@
 #ifndef _MY_STRING_H
 #define _MY_STRING_H
 
+#include <sys/types.h>
+
+/*
+ * A string which is being built in a buffer of known size. The length is
+ * kept, so an append copies only the new string instead of scanning what
+ * is already there, and the string is always null terminated.
+ */
+struct my_str {
+	char *buff;
+	size_t len;
+	/* Bytes of buff, the terminating null byte included. */
+	size_t size;
+};
+
 size_t my_strlen(const char *s);
 int my_strcmp(const char *s1, const char *s2);
 void my_strcat(char *dst, const char *src);
 void my_strcpy(char *dst, const char *src);
 
+/**
+ * Start an empty string.
+ *
+ * @param buff memory of the string
+ * @param size number of bytes of buff (at least 1)
+ */
+void my_str_init(struct my_str *str, char *buff, size_t size);
+
+/**
+ * Append n bytes to a string. What does not fit in the buffer is cut.
+ *
+ * @return 0, if everything was appended
+ *		   -1, if the string was cut
+ */
+int my_str_append_n(struct my_str *str, const char *s, size_t n);
+
+/**
+ * Append a string (NULL is the empty string). What does not fit in the
+ * buffer is cut.
+ *
+ * @return 0, if everything was appended
+ *		   -1, if the string was cut
+ */
+int my_str_append(struct my_str *str, const char *s);
+
 #endif /* _MY_STRING_H */
@@ -0,0 +1,225 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "path_cache.h"
+#include "env.h"
+#include "my_string.h"
+#include "my_stdio.h"
+
+#define NR_BUCKETS		64
+/* Search path used by execvp when PATH is not set. */
+#define DEFAULT_PATH		"/bin:/usr/bin"
+
+struct path_entry {
+	char *name;
+	/* NULL, if the name was not found in PATH. */
+	char *path;
+	unsigned int hits;
+	struct path_entry *next;
+};
+
+static struct path_entry *buckets[NR_BUCKETS];
+static size_t nr_entries;
+/* The last path found in a relative directory of PATH, which is not kept. */
+static char *uncached_path;
+/* The PATH in which the names were searched and the environment it was read from. */
+static char *searched_path;
+static unsigned long searched_generation = -1;
+
+/*****
+ * FNV-1a hash of a string.
+ *****/
+static unsigned int hash_name(const char *name)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return hash % NR_BUCKETS;
+}
+
+/*****
+ * @return the entry of a name
+ *		   NULL, if the name is not in the cache
+ *****/
+static struct path_entry *find_entry(const char *name)
+{
+	struct path_entry *entry = buckets[hash_name(name)];
+
+	while (entry && my_strcmp(entry->name, name))
+		entry = entry->next;
+	return entry;
+}
+
+/*****
+ * Search an executable in the directories from PATH, as execvp does.
+ *
+ * @return the path of the executable (allocated with malloc)
+ *		   NULL, if there is no such executable
+ *****/
+static char *search_path(const char *name)
+{
+	const char *dirs = env_get("PATH");
+	size_t name_len = my_strlen(name);
+
+	if (!dirs)
+		dirs = DEFAULT_PATH;
+
+	while (1) {
+		const char *end = strchrnul(dirs, ':');
+		size_t dir_len = end - dirs;
+		char *path = malloc(dir_len + name_len + 2);
+		struct stat st;
+
+		if (!path)
+			return NULL;
+
+		/* An empty directory means the current one. */
+		if (dir_len) {
+			memcpy(path, dirs, dir_len);
+			path[dir_len++] = '/';
+		}
+		memcpy(path + dir_len, name, name_len + 1);
+
+		if (!stat(path, &st) && S_ISREG(st.st_mode) && !access(path, X_OK))
+			return path;
+		free(path);
+
+		if (!*end)
+			return NULL;
+		dirs = end + 1;
+	}
+}
+
+/*****
+ * Forget all names if PATH changed since they were searched.
+ *****/
+static void check_path_env(void)
+{
+	/* The environment did not change since the last call. */
+	if (searched_generation == env_generation())
+		return;
+	searched_generation = env_generation();
+
+	const char *dirs = env_get("PATH");
+
+	if (dirs && searched_path ? !my_strcmp(dirs, searched_path) : dirs == searched_path)
+		return;
+
+	path_cache_clear();
+	free(searched_path);
+	searched_path = dirs ? strdup(dirs) : NULL;
+}
+
+const char *path_cache_lookup(const char *name)
+{
+	if (!name || !name[0])
+		return NULL;
+	if (strchr(name, '/'))
+		return name;
+
+	check_path_env();
+
+	struct path_entry *entry = find_entry(name);
+
+	if (!entry) {
+		/*
+		 * A path relative to the current directory is not kept, as it
+		 * changes with cd.
+		 */
+		char *path = search_path(name);
+
+		free(uncached_path);
+		uncached_path = NULL;
+		if (path && path[0] != '/') {
+			uncached_path = path;
+			return path;
+		}
+
+		entry = malloc(sizeof(*entry));
+		if (!entry) {
+			free(path);
+			return NULL;
+		}
+
+		entry->name = strdup(name);
+		if (!entry->name) {
+			free(entry);
+			free(path);
+			return NULL;
+		}
+		entry->path = path;
+		entry->hits = 0;
+
+		unsigned int bucket = hash_name(name);
+
+		entry->next = buckets[bucket];
+		buckets[bucket] = entry;
+		nr_entries++;
+	}
+
+	entry->hits++;
+	return entry->path;
+}
+
+void path_cache_forget(const char *name)
+{
+	struct path_entry **link = &buckets[hash_name(name)];
+
+	while (*link && my_strcmp((*link)->name, name))
+		link = &(*link)->next;
+
+	struct path_entry *entry = *link;
+
+	if (!entry)
+		return;
+
+	*link = entry->next;
+	free(entry->name);
+	free(entry->path);
+	free(entry);
+	nr_entries--;
+}
+
+void path_cache_clear(void)
+{
+	for (size_t i = 0; i < NR_BUCKETS; ++i)
+		while (buckets[i])
+			path_cache_forget(buckets[i]->name);
+}
+
+void path_cache_print(int fd)
+{
+	char line[4096];
+	int len;
+
+	check_path_env();
+	if (!nr_entries) {
+		my_fwrite("hash: hash table empty\n", 23, 1, fd);
+		return;
+	}
+
+	my_fwrite("hits\tcommand\n", 13, 1, fd);
+	for (size_t i = 0; i < NR_BUCKETS; ++i)
+		for (struct path_entry *entry = buckets[i]; entry; entry = entry->next) {
+			if (entry->path)
+				len = snprintf(line, sizeof(line), "%4u\t%s\n",
+					       entry->hits, entry->path);
+			else
+				len = snprintf(line, sizeof(line), "%4u\t%s: not found\n",
+					       entry->hits, entry->name);
+			if (len >= (int)sizeof(line))
+				len = sizeof(line) - 1;
+			my_fwrite(line, len, 1, fd);
+		}
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PATH_CACHE_H
+#define _PATH_CACHE_H
+
+/**
+ * Get the path of the executable of a command. PATH is searched only
+ * the first time a name is looked up; the result, found or not, is kept
+ * until the name is forgotten, the cache is cleared or PATH changes. A
+ * name found in a relative directory of PATH is searched every time.
+ *
+ * @param name the name of the command
+ * @return the path of the executable (name itself, if it contains a '/'),
+ *		   valid until the next call
+ *		   NULL, if the command can not be found
+ */
+const char *path_cache_lookup(const char *name);
+
+/**
+ * Forget what is known about a name (e.g. its executable was removed).
+ */
+void path_cache_forget(const char *name);
+
+/**
+ * Forget all names (hash -r). A change of PATH is noticed by
+ * path_cache_lookup().
+ */
+void path_cache_clear(void);
+
+/**
+ * Print the cache, like the hash builtin of bash.
+ *
+ * @param fd file in which the cache is printed
+ */
+void path_cache_print(int fd);
+
+#endif /* _PATH_CACHE_H */
@@ -0,0 +1,196 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+
+#include <poll.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pipes.h"
+#include "env.h"
+#include "my_string.h"
+#include "my_stdio.h"
+#include "stats.h"
+
+#define PIPE_SZ_ENV		"MINISHELL_PIPE_SZ"
+#define PIPE_SZ_AUTO		(-1)
+#define PIPE_MAX_SIZE_PATH	"/proc/sys/fs/pipe-max-size"
+
+/* Number of full pipes seen by a writer before its pipe is grown. */
+#define PIPE_STALLS_BEFORE_GROWTH	8
+
+/* The fds whose type is kept (see fd_type). */
+#define PIPE_FDS_KNOWN			64
+
+/* The fd for which the stalls are counted and their number. */
+static int stalled_fd = -1;
+static int stalls;
+
+/* The policy and the environment it was read from (see env_generation). */
+static int policy;
+static unsigned long policy_generation = -1;
+
+/* Whether an fd is a pipe: 0 if it was not checked yet, 1 if it is, -1 if not. */
+static signed char fd_type[PIPE_FDS_KNOWN];
+
+/*****
+ * @return the capacity asked by a value of MINISHELL_PIPE_SZ
+ *		   PIPE_SZ_AUTO, in auto mode
+ *		   0, if the default capacity must be kept
+ *****/
+static int parse_pipe_size_policy(const char *policy)
+{
+	if (!policy || !policy[0])
+		return 0;
+	if (!my_strcmp(policy, "auto"))
+		return PIPE_SZ_AUTO;
+
+	char *end;
+	long size = strtol(policy, &end, 10);
+
+	if (*end == 'k' || *end == 'K')
+		size <<= 10, end++;
+	else if (*end == 'm' || *end == 'M')
+		size <<= 20, end++;
+
+	if (*end || size <= 0 || size > (1 << 30))
+		return 0;
+	return size;
+}
+
+/*****
+ * @return the capacity asked by MINISHELL_PIPE_SZ (see parse_pipe_size_policy)
+ *****/
+static int get_pipe_size_policy(void)
+{
+	/* The environment did not change since the last call. */
+	if (policy_generation != env_generation()) {
+		policy_generation = env_generation();
+		policy = parse_pipe_size_policy(env_get(PIPE_SZ_ENV));
+	}
+	return policy;
+}
+
+/*****
+ * @return whether fd is a pipe; fstat() is called once per fd
+ *****/
+static bool is_pipe(int fd)
+{
+	struct stat st;
+	bool pipe;
+
+	if (fd < 0)
+		return false;
+	if (fd < PIPE_FDS_KNOWN && fd_type[fd])
+		return fd_type[fd] > 0;
+
+	pipe = fstat(fd, &st) != -1 && S_ISFIFO(st.st_mode);
+	if (fd < PIPE_FDS_KNOWN)
+		fd_type[fd] = pipe ? 1 : -1;
+	return pipe;
+}
+
+void pipe_fd_changed(int fd)
+{
+	if (fd >= 0 && fd < PIPE_FDS_KNOWN)
+		fd_type[fd] = 0;
+}
+
+/*****
+ * Tell, only once, that the kernel did not give the capacity asked by
+ * MINISHELL_PIPE_SZ (see /proc/sys/fs/pipe-max-size).
+ *****/
+static void report_pipe_size(int wanted, int got)
+{
+	static int reported;
+	char message[128];
+	int len;
+
+	if (reported)
+		return;
+	reported = 1;
+
+	len = snprintf(message, sizeof(message), "mini-shell: pipe size is %d, not %d\n",
+		       got, wanted);
+	my_fwrite(message, len, 1, 2);
+}
+
+/*****
+ * @return the largest capacity that an unprivileged process may ask for
+ *		   0, if it is not known
+ *****/
+static int get_max_pipe_size(void)
+{
+	static int max_size = -1;
+
+	if (max_size != -1)
+		return max_size;
+
+	char buff[32];
+	int fd = open(PIPE_MAX_SIZE_PATH, O_RDONLY | O_CLOEXEC);
+	ssize_t n = fd != -1 ? read(fd, buff, sizeof(buff) - 1) : -1;
+
+	if (fd != -1)
+		close(fd);
+	buff[n > 0 ? n : 0] = '\0';
+	max_size = atoi(buff);
+	return max_size;
+}
+
+int pipe_open(int fd[2])
+{
+	if (pipe2(fd, O_CLOEXEC) == -1)
+		return -1;
+	stat_inc(STAT_PIPES);
+	pipe_fd_changed(fd[0]);
+	pipe_fd_changed(fd[1]);
+
+	int size = get_pipe_size_policy();
+
+	if (size > 0) {
+		int got = fcntl(fd[1], F_SETPIPE_SZ, size);
+
+		/* Asking for more than the limit fails, so ask for the limit. */
+		if (got == -1 && get_max_pipe_size() > 0 && get_max_pipe_size() < size)
+			got = fcntl(fd[1], F_SETPIPE_SZ, get_max_pipe_size());
+
+		if (got < size) {
+			got = fcntl(fd[1], F_GETPIPE_SZ);
+			report_pipe_size(size, got);
+		}
+		return got;
+	}
+
+	return fcntl(fd[1], F_GETPIPE_SZ);
+}
+
+void pipe_before_write(int fd)
+{
+	if (get_pipe_size_policy() != PIPE_SZ_AUTO || !is_pipe(fd))
+		return;
+
+	if (fd != stalled_fd) {
+		stalled_fd = fd;
+		stalls = 0;
+	}
+
+	/* A pipe which is not writable right now is full. */
+	struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+
+	if (poll(&pfd, 1, 0) != 0)
+		return;
+
+	if (++stalls < PIPE_STALLS_BEFORE_GROWTH)
+		return;
+	stalls = 0;
+
+	int size = fcntl(fd, F_GETPIPE_SZ);
+
+	if (size > 0 && (!get_max_pipe_size() || 2 * size <= get_max_pipe_size()))
+		fcntl(fd, F_SETPIPE_SZ, 2 * size);
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PIPES_H
+#define _PIPES_H
+
+/*
+ * The capacity of the pipes created by the shell is chosen by the
+ * MINISHELL_PIPE_SZ environment variable:
+ *		unset or empty ==> the default capacity of the kernel
+ *		<bytes>[k|m] ==> a fixed capacity (e.g. 1m)
+ *		auto ==> the default capacity, doubled every time a writer
+ *				 of the shell finds the pipe full too often
+ */
+
+/**
+ * Create a pipe (both ends are O_CLOEXEC) and set its capacity.
+ *
+ * @param fd array in which the ends of the pipe are saved
+ * @return the capacity of the pipe, as given by the kernel
+ *		   -1, if the pipe could not be created
+ */
+int pipe_open(int fd[2]);
+
+/**
+ * Called by the writers of the shell (e.g. the internal cat) before they
+ * write to fd. In auto mode, it counts how often fd is full and grows
+ * the pipe when that happens too often. It does nothing in other modes,
+ * or if fd is not a pipe.
+ */
+void pipe_before_write(int fd);
+
+/**
+ * Forget what is known about fd, e.g. after a dup2() on it.
+ */
+void pipe_fd_changed(int fd);
+
+#endif /* _PIPES_H */
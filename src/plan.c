@@ -0,0 +1,439 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdalign.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "plan.h"
+#include "utils.h"
+#include "my_string.h"
+#include "my_stdio.h"
+
+#define NR_BUCKETS		64
+/* The cache is emptied when it is full. */
+#define MAX_PLANS		256
+#define CHUNK_SIZE		4096
+#define MIN_INSNS		16
+
+/* The copy of the tree is allocated in chunks, freed with the plan. */
+struct chunk {
+	struct chunk *next;
+	size_t used;
+	size_t size;
+	alignas(max_align_t) char data[];
+};
+
+struct plan_entry {
+	char *line;
+	struct plan plan;
+	struct chunk *chunks;
+	size_t insns_size;
+	/* An allocation failed while the plan was compiled. */
+	bool failed;
+	struct plan_entry *next;
+};
+
+static const char * const op_names[] = {
+	[PLAN_EXTERNAL] = "external",
+	[PLAN_BUILTIN] = "builtin",
+	[PLAN_ASSIGN] = "assign",
+	[PLAN_SIMPLE] = "simple",
+	[PLAN_PIPE] = "pipe",
+	[PLAN_PARALLEL] = "parallel",
+	[PLAN_BACKGROUND] = "background",
+	[PLAN_SET] = "set",
+	[PLAN_BRANCH_ZERO] = "branch_zero",
+	[PLAN_BRANCH_NONZERO] = "branch_nonzero",
+};
+
+static struct plan_entry *buckets[NR_BUCKETS];
+static size_t nr_plans;
+
+/*****
+ * FNV-1a hash of a string.
+ *****/
+static unsigned int hash_line(const char *line)
+{
+	unsigned int hash = 2166136261u;
+
+	while (*line) {
+		hash ^= (unsigned char)*line++;
+		hash *= 16777619u;
+	}
+	return hash % NR_BUCKETS;
+}
+
+/*****
+ * @return memory aligned for any type, which lives as long as the plan
+ *		   NULL, if there is no more memory (e->failed is set)
+ *****/
+static void *plan_alloc(struct plan_entry *e, size_t size)
+{
+	struct chunk *chunk = e->chunks;
+
+	size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+	if (!chunk || chunk->used + size > chunk->size) {
+		size_t chunk_size = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+
+		chunk = malloc(sizeof(*chunk) + chunk_size);
+		if (!chunk) {
+			e->failed = true;
+			return NULL;
+		}
+		chunk->used = 0;
+		chunk->size = chunk_size;
+		chunk->next = e->chunks;
+		e->chunks = chunk;
+	}
+
+	void *p = chunk->data + chunk->used;
+
+	chunk->used += size;
+	return p;
+}
+
+static char *copy_string(struct plan_entry *e, const char *string)
+{
+	size_t size = my_strlen(string) + 1;
+	char *copy = plan_alloc(e, size);
+
+	if (copy)
+		memcpy(copy, string, size);
+	return copy;
+}
+
+/*****
+ * Copy a list of words, with all their parts.
+ *****/
+static word_t *copy_words(struct plan_entry *e, const word_t *word)
+{
+	word_t *first = NULL, **link = &first;
+
+	for (; word; word = word->next_word) {
+		word_t *copy = plan_alloc(e, sizeof(*copy));
+
+		if (!copy)
+			return NULL;
+
+		copy->string = word->string ? copy_string(e, word->string) : NULL;
+		copy->expand = word->expand;
+		copy->next_part = copy_words(e, word->next_part);
+		copy->next_word = NULL;
+
+		*link = copy;
+		link = &copy->next_word;
+	}
+	return first;
+}
+
+static command_t *copy_command(struct plan_entry *e, const command_t *c, command_t *up)
+{
+	if (!c)
+		return NULL;
+
+	command_t *copy = plan_alloc(e, sizeof(*copy));
+
+	if (!copy)
+		return NULL;
+
+	*copy = *c;
+	copy->up = up;
+	copy->aux = NULL;
+	copy->cmd1 = copy_command(e, c->cmd1, copy);
+	copy->cmd2 = copy_command(e, c->cmd2, copy);
+
+	if (c->scmd) {
+		simple_command_t *s = plan_alloc(e, sizeof(*s));
+
+		if (!s)
+			return NULL;
+
+		*s = *c->scmd;
+		s->verb = copy_words(e, c->scmd->verb);
+		s->params = copy_words(e, c->scmd->params);
+		s->in = copy_words(e, c->scmd->in);
+		s->out = copy_words(e, c->scmd->out);
+		/* "&>" puts the same word in both lists (see cmd.c). */
+		s->err = c->scmd->err == c->scmd->out ? s->out : copy_words(e, c->scmd->err);
+		s->up = copy;
+		s->aux = NULL;
+		copy->scmd = s;
+	}
+	return copy;
+}
+
+/*****
+ * @return true, if no part of the words is an environment variable
+ *****/
+static bool is_literal(const word_t *word)
+{
+	for (; word; word = word->next_word)
+		for (const word_t *part = word; part; part = part->next_part)
+			if (part->expand)
+				return false;
+	return true;
+}
+
+/*****
+ * Build the argv of a command whose words need no expansion, in the
+ * memory of the plan.
+ *****/
+static char **literal_argv(struct plan_entry *e, simple_command_t *s)
+{
+	size_t nr_words = 0;
+
+	for (const word_t *word = s->params; word; word = word->next_word)
+		nr_words++;
+
+	char **argv = plan_alloc(e, (nr_words + 2) * sizeof(char *));
+	size_t pos = 0;
+
+	if (!argv)
+		return NULL;
+
+	argv[pos++] = (char *)s->verb->string;
+	for (const word_t *word = s->params; word; word = word->next_word) {
+		struct my_str str;
+		size_t size = 1;
+
+		for (const word_t *part = word; part; part = part->next_part)
+			size += my_strlen(part->string);
+
+		argv[pos] = plan_alloc(e, size);
+		if (!argv[pos])
+			return NULL;
+
+		my_str_init(&str, argv[pos], size);
+		for (const word_t *part = word; part; part = part->next_part)
+			my_str_append(&str, part->string);
+		pos++;
+	}
+	argv[pos] = NULL;
+	return argv;
+}
+
+/*****
+ * Append an instruction to the plan.
+ *
+ * @return the instruction
+ *		   NULL, if there is no more memory (e->failed is set)
+ *****/
+static struct plan_insn *emit(struct plan_entry *e, enum plan_op op, int level, command_t *c)
+{
+	struct plan *plan = &e->plan;
+
+	if (plan->nr_insns == e->insns_size) {
+		size_t size = e->insns_size ? 2 * e->insns_size : MIN_INSNS;
+		struct plan_insn *insns = realloc(plan->insns, size * sizeof(*insns));
+
+		if (!insns) {
+			e->failed = true;
+			return NULL;
+		}
+		plan->insns = insns;
+		e->insns_size = size;
+	}
+
+	struct plan_insn *insn = &plan->insns[plan->nr_insns++];
+
+	insn->op = op;
+	insn->level = level;
+	insn->cmd = c;
+	insn->builtin = NULL;
+	insn->value = 0;
+	insn->target = 0;
+	return insn;
+}
+
+/*****
+ * Choose how a simple command runs. What depends on the environment is
+ * left for the time it runs.
+ *****/
+static void lower_simple(struct plan_entry *e, command_t *c, int level)
+{
+	simple_command_t *s = c->scmd;
+	bool literal_verb = is_literal(s->verb);
+	bool literal = literal_verb && is_literal(s->params);
+	const struct builtin *b = literal_verb ? builtin_find(s) : NULL;
+	enum plan_op op = PLAN_EXTERNAL;
+
+	if (s->verb->next_part && !my_strcmp(s->verb->next_part->string, "="))
+		op = PLAN_ASSIGN;
+	else if (!literal_verb || (!my_strcmp(s->verb->string, "time") && s->params))
+		op = PLAN_SIMPLE;
+	else if (b && (literal || !b->accepts))
+		op = PLAN_BUILTIN;
+	else if (!literal)
+		/* Whether a builtin accepts the parameters may change (e.g. cat). */
+		op = PLAN_SIMPLE;
+
+	struct plan_insn *insn = emit(e, op, level, c);
+
+	if (!insn)
+		return;
+	insn->builtin = b;
+
+	if (literal && op != PLAN_ASSIGN)
+		s->aux = literal_argv(e, s);
+}
+
+/*****
+ * Append the instructions of a command.
+ *****/
+static void lower(struct plan_entry *e, command_t *c, int level)
+{
+	struct plan_insn *insn;
+	size_t branch;
+
+	switch (c->op) {
+	case OP_NONE:
+		lower_simple(e, c, level);
+		break;
+
+	case OP_SEQUENTIAL:
+		lower(e, c->cmd1, level + 1);
+		lower(e, c->cmd2, level + 1);
+		insn = emit(e, PLAN_SET, level, c);
+		if (insn)
+			insn->value = 0;
+		break;
+
+	case OP_CONDITIONAL_ZERO:
+	case OP_CONDITIONAL_NZERO:
+		lower(e, c->cmd1, level + 1);
+		branch = e->plan.nr_insns;
+		insn = emit(e, c->op == OP_CONDITIONAL_ZERO ?
+			    PLAN_BRANCH_NONZERO : PLAN_BRANCH_ZERO, level, c);
+		if (!insn)
+			return;
+		/* The status of "a && b" is -1 when a fails. */
+		insn->value = c->op == OP_CONDITIONAL_ZERO ? -1 : 0;
+		lower(e, c->cmd2, level + 1);
+		if (!e->failed)
+			e->plan.insns[branch].target = e->plan.nr_insns;
+		break;
+
+	case OP_PIPE:
+		emit(e, PLAN_PIPE, level + 1, c);
+		break;
+
+	case OP_PARALLEL:
+		emit(e, PLAN_PARALLEL, level + 1, c);
+		break;
+
+	case OP_BACKGROUND:
+		emit(e, PLAN_BACKGROUND, level + 1, c->cmd1);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void free_entry(struct plan_entry *e)
+{
+	while (e->chunks) {
+		struct chunk *next = e->chunks->next;
+
+		free(e->chunks);
+		e->chunks = next;
+	}
+	free(e->plan.insns);
+	free(e->line);
+	free(e);
+}
+
+struct plan *plan_find(const char *line)
+{
+	for (struct plan_entry *e = buckets[hash_line(line)]; e; e = e->next)
+		if (!my_strcmp(e->line, line)) {
+			e->plan.hits++;
+			return &e->plan;
+		}
+	return NULL;
+}
+
+struct plan *plan_compile(const char *line, command_t *root)
+{
+	struct plan_entry *e = calloc(1, sizeof(*e));
+
+	if (!e)
+		return NULL;
+
+	e->line = strdup(line);
+	e->plan.root = copy_command(e, root, NULL);
+	if (e->line && e->plan.root)
+		lower(e, e->plan.root, 0);
+
+	if (!e->line || !e->plan.root || e->failed) {
+		free_entry(e);
+		return NULL;
+	}
+
+	if (nr_plans == MAX_PLANS)
+		plan_cache_clear();
+
+	unsigned int bucket = hash_line(line);
+
+	e->next = buckets[bucket];
+	buckets[bucket] = e;
+	nr_plans++;
+	return &e->plan;
+}
+
+void plan_dump(const struct plan *plan, int fd)
+{
+	char buff[512];
+	int len;
+
+	len = snprintf(buff, sizeof(buff), "plan: %zu instructions, %u hits\n",
+		       plan->nr_insns, plan->hits);
+	my_fwrite(buff, len, 1, fd);
+
+	for (size_t i = 0; i < plan->nr_insns; ++i) {
+		const struct plan_insn *insn = &plan->insns[i];
+
+		switch (insn->op) {
+		case PLAN_SET:
+			len = snprintf(buff, sizeof(buff), "%4zu  %-16sstatus = %d\n",
+				       i, op_names[insn->op], insn->value);
+			break;
+		case PLAN_BRANCH_ZERO:
+		case PLAN_BRANCH_NONZERO:
+			len = snprintf(buff, sizeof(buff), "%4zu  %-16sstatus = %d, goto %zu\n",
+				       i, op_names[insn->op], insn->value, insn->target);
+			break;
+		default: {
+			char *text = get_command_text(insn->cmd);
+			bool ready = insn->cmd->op == OP_NONE && insn->cmd->scmd->aux;
+
+			len = snprintf(buff, sizeof(buff), "%4zu  %-16slevel %d%s  %s\n",
+				       i, op_names[insn->op], insn->level,
+				       ready ? ", argv ready" : "", text ? text : "");
+			free(text);
+			break;
+		}
+		}
+
+		if (len >= (int)sizeof(buff)) {
+			/* The command is cut. */
+			len = sizeof(buff);
+			buff[len - 1] = '\n';
+		}
+		my_fwrite(buff, len, 1, fd);
+	}
+}
+
+void plan_cache_clear(void)
+{
+	for (int i = 0; i < NR_BUCKETS; ++i)
+		while (buckets[i]) {
+			struct plan_entry *next = buckets[i]->next;
+
+			free_entry(buckets[i]);
+			buckets[i] = next;
+		}
+	nr_plans = 0;
+}
@@ -0,0 +1,94 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _PLAN_H
+#define _PLAN_H
+
+#include <sys/types.h>
+
+#include "../util/parser/parser.h"
+#include "builtins.h"
+
+/*
+ * A command line lowered to a flat array of instructions. The operators
+ * which only decide what runs next (;, &&, ||) become branches on the
+ * status of the last command; the groups which need several processes
+ * (|, & and a trailing &) stay a single instruction, run by cmd.c.
+ *
+ * A plan owns a copy of its parse tree, so it outlives the parser memory
+ * and is kept in a cache indexed by the text of the line. In the copy, the
+ * aux field of a simple command whose words need no expansion points to
+ * its argv, built once when the plan is compiled.
+ */
+
+enum plan_op {
+	/* Run an executable and wait for it. */
+	PLAN_EXTERNAL,
+	/* Run a builtin, with the redirections of the command. */
+	PLAN_BUILTIN,
+	/* Set an environment variable. */
+	PLAN_ASSIGN,
+	/* A simple command known only when it runs (e.g. "$CMD", time). */
+	PLAN_SIMPLE,
+	PLAN_PIPE,
+	PLAN_PARALLEL,
+	PLAN_BACKGROUND,
+	/* status = value */
+	PLAN_SET,
+	/* if (status == 0) { status = value; jump to target } */
+	PLAN_BRANCH_ZERO,
+	/* if (status != 0) { status = value; jump to target } */
+	PLAN_BRANCH_NONZERO,
+};
+
+struct plan_insn {
+	enum plan_op op;
+	/* The level of the command, for tracing. */
+	int level;
+	/* The command run by the instruction (for the others, the operator). */
+	command_t *cmd;
+	/* The builtin of a PLAN_BUILTIN. */
+	const struct builtin *builtin;
+	int value;
+	size_t target;
+};
+
+struct plan {
+	/* The copy of the parse tree. */
+	command_t *root;
+	struct plan_insn *insns;
+	size_t nr_insns;
+	/* Number of times the plan was found in the cache. */
+	unsigned int hits;
+};
+
+/**
+ * Get the plan of a line which was run before.
+ *
+ * @return the plan
+ *		   NULL, if the line is not in the cache
+ */
+struct plan *plan_find(const char *line);
+
+/**
+ * Compile a parse tree and add the plan to the cache.
+ *
+ * @param line the text of the line, the key of the cache
+ * @param root the parse tree of the line (it is copied)
+ * @return the plan
+ *		   NULL, if there is no memory
+ */
+struct plan *plan_compile(const char *line, command_t *root);
+
+/**
+ * Print the instructions of a plan (the --dump-plan option).
+ *
+ * @param fd file in which the plan is printed
+ */
+void plan_dump(const struct plan *plan, int fd);
+
+/**
+ * Forget all the plans.
+ */
+void plan_cache_clear(void);
+
+#endif /* _PLAN_H */
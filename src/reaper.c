@@ -0,0 +1,262 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "reaper.h"
+#include "acct.h"
+#include "my_stdio.h"
+#include "stats.h"
+
+#define MAX_EVENTS		16
+
+struct child {
+	pid_t pid;
+	int group;
+	/* -1, if pidfds are not supported. */
+	int pidfd;
+	int done;
+	int status;
+	struct rusage ru;
+	/* When the child was registered (see stat_now). */
+	uint64_t start;
+};
+
+static struct child *children;
+static size_t nr_children;
+static size_t children_size;
+
+/* -1, if it was not created yet. */
+static int epoll_fd = -1;
+static int last_group;
+
+int reaper_new_group(void)
+{
+	return ++last_group;
+}
+
+/*****
+ * @return the watched child with the given pid
+ *		   NULL, if there is no such child
+ *****/
+static struct child *find_child(pid_t pid)
+{
+	for (size_t i = 0; i < nr_children; ++i)
+		if (children[i].pid == pid)
+			return &children[i];
+	return NULL;
+}
+
+/*****
+ * Give the result of a finished child and stop watching it.
+ *****/
+static void remove_child(struct child *c, int *status, struct rusage *ru)
+{
+	*status = c->status;
+	if (ru)
+		*ru = c->ru;
+
+	*c = children[--nr_children];
+}
+
+/*****
+ * Reap a child which finished and keep its status and resource usage.
+ *****/
+static void reap(struct child *c)
+{
+	while (wait4(c->pid, &c->status, 0, &c->ru) == -1 && errno == EINTR)
+		;
+	acct_reaped(&c->ru);
+	stat_record(STAT_CHILD_LATENCY, stat_now() - c->start);
+
+	if (c->pidfd != -1) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->pidfd, NULL);
+		close(c->pidfd);
+		c->pidfd = -1;
+	}
+	c->done = 1;
+}
+
+/*****
+ * Reap the children which finished.
+ *
+ * @param block whether to wait until at least one more child finishes
+ * @return number of children reaped
+ *		  -1, if there is nothing to wait for or an error happened
+ *****/
+static int reap_finished(int block)
+{
+	struct epoll_event events[MAX_EVENTS];
+	int n;
+
+	/* Nothing printed may wait for the children. */
+	if (block)
+		my_flush();
+
+	if (epoll_fd == -1) {
+		/* No pidfds: wait for any child. */
+		struct rusage ru;
+		int status;
+		pid_t pid;
+
+		do {
+			pid = wait4(-1, &status, block ? 0 : WNOHANG, &ru);
+		} while (pid == -1 && errno == EINTR);
+		if (pid <= 0)
+			return pid;
+
+		struct child *c = find_child(pid);
+
+		if (c) {
+			c->status = status;
+			c->ru = ru;
+			c->done = 1;
+			acct_reaped(&ru);
+			stat_record(STAT_CHILD_LATENCY, stat_now() - c->start);
+		}
+		return 1;
+	}
+
+	do {
+		n = epoll_wait(epoll_fd, events, MAX_EVENTS, block ? -1 : 0);
+	} while (n == -1 && errno == EINTR);
+	if (n == -1)
+		return -1;
+
+	for (int i = 0; i < n; ++i) {
+		struct child *c = find_child((pid_t)events[i].data.u64);
+
+		if (c && !c->done)
+			reap(c);
+	}
+	return n;
+}
+
+int reaper_reserve(void)
+{
+	if (nr_children == children_size) {
+		size_t size = children_size ? 2 * children_size : 16;
+		struct child *new_children = realloc(children, size * sizeof(*children));
+
+		if (!new_children)
+			return -1;
+		children = new_children;
+		children_size = size;
+	}
+	return 0;
+}
+
+int reaper_add(pid_t pid, int group)
+{
+	if (reaper_reserve() == -1)
+		return -1;
+
+	struct child *c = &children[nr_children];
+
+	c->pid = pid;
+	c->group = group;
+	c->done = 0;
+	c->start = stat_now();
+	c->pidfd = syscall(SYS_pidfd_open, pid, 0);
+
+	if (c->pidfd != -1 && epoll_fd == -1 && !nr_children)
+		epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+	if (c->pidfd != -1) {
+		struct epoll_event event = { .events = EPOLLIN, .data.u64 = pid };
+
+		if (epoll_fd == -1 || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, c->pidfd, &event) == -1) {
+			close(c->pidfd);
+			c->pidfd = -1;
+		}
+	}
+
+	/* A child without pidfd can only be found by waiting for any child. */
+	if (c->pidfd == -1 && epoll_fd != -1) {
+		for (size_t i = 0; i < nr_children; ++i)
+			if (children[i].pidfd != -1) {
+				epoll_ctl(epoll_fd, EPOLL_CTL_DEL, children[i].pidfd, NULL);
+				close(children[i].pidfd);
+				children[i].pidfd = -1;
+			}
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+
+	nr_children++;
+	return 0;
+}
+
+int reaper_wait(pid_t pid, int *status, struct rusage *ru)
+{
+	struct child *c;
+
+	while ((c = find_child(pid)) && !c->done)
+		if (reap_finished(1) == -1)
+			return -1;
+
+	if (!c)
+		return -1;
+
+	remove_child(c, status, ru);
+	return 0;
+}
+
+pid_t reaper_wait_any(int group, int *status, struct rusage *ru)
+{
+	while (1) {
+		int pending = 0;
+
+		for (size_t i = 0; i < nr_children; ++i) {
+			if (children[i].group != group)
+				continue;
+			if (children[i].done) {
+				pid_t pid = children[i].pid;
+
+				remove_child(&children[i], status, ru);
+				return pid;
+			}
+			pending = 1;
+		}
+
+		if (!pending || reap_finished(1) == -1)
+			return -1;
+	}
+}
+
+pid_t reaper_poll(int group, int *status, struct rusage *ru)
+{
+	while (reap_finished(0) > 0)
+		;
+
+	for (size_t i = 0; i < nr_children; ++i)
+		if (children[i].group == group && children[i].done) {
+			pid_t pid = children[i].pid;
+
+			remove_child(&children[i], status, ru);
+			return pid;
+		}
+	return -1;
+}
+
+void reaper_forget_all(void)
+{
+	for (size_t i = 0; i < nr_children; ++i)
+		if (children[i].pidfd != -1)
+			close(children[i].pidfd);
+	nr_children = 0;
+
+	/* The epoll instance is shared with the parent. */
+	if (epoll_fd != -1)
+		close(epoll_fd);
+	epoll_fd = -1;
+}
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _REAPER_H
+#define _REAPER_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+
+/*
+ * Every child of the shell is registered here. The reaper watches the
+ * children with pidfds and epoll, reaps them in the order in which they
+ * finish and keeps their exit status and resource usage until somebody
+ * asks for them. Children belong to groups (e.g. the stages of a
+ * pipeline), so a group can be waited for without reaping the others.
+ */
+
+/**
+ * @return a new group id (never 0)
+ */
+int reaper_new_group(void);
+
+/**
+ * Make room for one more child, so that the next reaper_add can not fail.
+ * It must be called before the child is started: a child which is not
+ * watched is never reaped.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ */
+int reaper_reserve(void);
+
+/**
+ * Start watching a child.
+ *
+ * @param pid the pid of the child
+ * @param group the group of the child (0, for no group)
+ * @return 0, if the function finished successfully
+ *		  -1, if there was no room for it (never after reaper_reserve)
+ */
+int reaper_add(pid_t pid, int group);
+
+/**
+ * Wait for a given child.
+ *
+ * @param status (*)where the wait status is saved
+ * @param ru (*)where the resource usage is saved (it may be NULL)
+ * @return 0, if the function finished successfully
+ *		  -1, if pid is not watched
+ */
+int reaper_wait(pid_t pid, int *status, struct rusage *ru);
+
+/**
+ * Wait for the first child of a group which finishes.
+ *
+ * @param status (*)where the wait status is saved
+ * @param ru (*)where the resource usage is saved (it may be NULL)
+ * @return the pid of the child
+ *		   -1, if the group has no more children
+ */
+pid_t reaper_wait_any(int group, int *status, struct rusage *ru);
+
+/**
+ * Like reaper_wait_any, but it never blocks.
+ *
+ * @return the pid of a child of the group which finished
+ *		   -1, if no child of the group finished yet
+ */
+pid_t reaper_poll(int group, int *status, struct rusage *ru);
+
+/**
+ * Forget the children of the parent. It must be called in a forked child,
+ * before it starts children of its own.
+ */
+void reaper_forget_all(void);
+
+#endif /* _REAPER_H */
@@ -0,0 +1,177 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../util/parser/parser.h"
+#include "redirect.h"
+#include "my_string.h"
+#include "my_stdio.h"
+#include "stats.h"
+#include "pipes.h"
+
+/* The saved streams are moved out of the way of the commands' fds. */
+#define MIN_SAVED_FD		10
+/* saved[i] of a stream which was closed before redirect_apply(). */
+#define STREAM_CLOSED		-2
+
+/*****
+ * @return the flags with which the file of a stream is opened
+ *****/
+static int open_flags(int stream, int io_flags)
+{
+	switch (stream) {
+	case 0:
+		return O_RDONLY | O_CLOEXEC;
+	case 1:
+		return O_WRONLY | O_CREAT | O_CLOEXEC |
+		       (io_flags & IO_OUT_APPEND ? O_APPEND : O_TRUNC);
+	default:
+		return O_WRONLY | O_CREAT | O_CLOEXEC |
+		       (io_flags & IO_ERR_APPEND ? O_APPEND : O_TRUNC);
+	}
+}
+
+/*****
+ * @param target where the stream goes (IO_TO_*)
+ * @param stream 1 (stdout) or 2 (stderr)
+ * @param old where stdout and stderr went before the redirections
+ * @param file the first file of each stream or, without one, where it went
+ * @return the fd which becomes the stream
+ *****/
+static int target_fd(int target, int stream, const int old[3], const int file[3])
+{
+	switch (target) {
+	case IO_TO_OTHER:
+		return file[3 - stream];
+	case IO_TO_OLD_OUT:
+		return old[1];
+	case IO_TO_OLD_ERR:
+		return old[2];
+	default:
+		return file[stream];
+	}
+}
+
+int redirect_open(struct redirect *r, const char * const names[3], int io_flags,
+		  int in_fd, int out_fd)
+{
+	const int old[3] = { in_fd, out_fd != -1 ? out_fd : 1, 2 };
+	int file[3];
+
+	for (int i = 0; i < 3; ++i)
+		r->opened[i] = r->saved[i] = -1;
+
+	for (int i = 0; i < 3; ++i) {
+		file[i] = old[i];
+		if (!names[i])
+			continue;
+
+		/* Both streams write to the same file through the same fd. */
+		if (i == 2 && names[1] && !my_strcmp(names[1], names[2])) {
+			file[2] = file[1];
+			continue;
+		}
+
+		r->opened[i] = open(names[i], open_flags(i, io_flags), 0744);
+		if (r->opened[i] == -1) {
+			const char *error = strerror(errno);
+			struct iovec iov[] = {
+				{ "mini-shell: ", 12 },
+				{ (char *)names[i], my_strlen(names[i]) },
+				{ ": ", 2 },
+				{ (char *)error, my_strlen(error) },
+				{ "\n", 1 },
+			};
+
+			my_fwritev(iov, sizeof(iov) / sizeof(iov[0]), STDERR_FILENO);
+
+			redirect_close(r);
+			return -1;
+		}
+		file[i] = r->opened[i];
+	}
+
+	/* A stream which is not redirected is the one of the shell. */
+	r->fd[0] = file[0];
+	r->fd[1] = target_fd(IO_OUT_TARGET(io_flags), 1, old, file);
+	r->fd[2] = target_fd(IO_ERR_TARGET(io_flags), 2, old, file);
+
+	return 0;
+}
+
+/*****
+ * Save stream i of the shell and make r->fd[i] that stream.
+ *
+ * @return 0, if the function finished successfully
+ *		   -1, else
+ *****/
+static int apply_stream(struct redirect *r, int i)
+{
+	r->saved[i] = fcntl(i, F_DUPFD_CLOEXEC, MIN_SAVED_FD);
+	if (r->saved[i] == -1) {
+		if (errno != EBADF)
+			return -1;
+		r->saved[i] = STREAM_CLOSED;
+	}
+
+	/* What is buffered goes to the old stream. */
+	my_flush();
+	stat_inc(STAT_DUP2);
+	if (dup2(r->fd[i], i) == -1)
+		return -1;
+	pipe_fd_changed(i);
+	return 0;
+}
+
+int redirect_apply(struct redirect *r)
+{
+	/* A copy of a standard stream is made before that stream is replaced. */
+	for (int copies = 1; copies >= 0; --copies)
+		for (int i = 0; i < 3; ++i)
+			if (r->fd[i] != -1 && r->fd[i] != i &&
+			    (r->fd[i] < 3) == copies && apply_stream(r, i) == -1) {
+				redirect_restore(r);
+				return -1;
+			}
+	return 0;
+}
+
+int redirect_restore(struct redirect *r)
+{
+	int ret = 0;
+
+	for (int i = 0; i < 3; ++i) {
+		/* What is buffered goes to the streams of the command. */
+		if (r->saved[i] != -1)
+			my_flush();
+
+		if (r->saved[i] == STREAM_CLOSED) {
+			close(i);
+			pipe_fd_changed(i);
+		} else if (r->saved[i] != -1) {
+			stat_inc(STAT_DUP2);
+			if (dup2(r->saved[i], i) == -1)
+				ret = -1;
+			close(r->saved[i]);
+			pipe_fd_changed(i);
+		}
+		r->saved[i] = -1;
+	}
+
+	redirect_close(r);
+	return ret;
+}
+
+void redirect_close(struct redirect *r)
+{
+	for (int i = 0; i < 3; ++i)
+		if (r->opened[i] != -1) {
+			close(r->opened[i]);
+			r->opened[i] = -1;
+		}
+}
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _REDIRECT_H
+#define _REDIRECT_H
+
+/*
+ * The redirections of a command, resolved before it runs: the files are
+ * opened once, by the shell, and every standard stream gets the fd which
+ * must become it. A stream shared with another one ("&>", "2>&1", or the
+ * same name in "> f 2> f") gets the same fd, so the file is opened only
+ * once.
+ *
+ * The files are opened with O_CLOEXEC: a spawned command gets only its
+ * standard streams (see spawn_command) and a builtin changes the streams
+ * of the shell with redirect_apply() until redirect_restore().
+ */
+
+struct redirect {
+	/* The fd which becomes stdin, stdout and stderr (-1 or itself: unchanged). */
+	int fd[3];
+	/* The files opened for the command (-1: none). */
+	int opened[3];
+	/* The streams of the shell saved by redirect_apply() (-1: none). */
+	int saved[3];
+};
+
+/**
+ * Open the files of the redirections of a command. If a file can not
+ * be opened, the error is printed on stderr and nothing is left open.
+ *
+ * @param names the files of stdin, stdout and stderr (NULL: no file)
+ * @param io_flags the IO_* flags of the command, with where stdout and
+ *		  stderr go
+ * @param in_fd fd which becomes stdin when there is no file, e.g. the end
+ *		  of a pipe (-1: none)
+ * @param out_fd fd which becomes stdout when there is no file (-1: none)
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ */
+int redirect_open(struct redirect *r, const char * const names[3], int io_flags,
+		  int in_fd, int out_fd);
+
+/**
+ * Make the fds of the redirections the standard streams of the shell.
+ * The old streams are saved, so a failure leaves them unchanged.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ */
+int redirect_apply(struct redirect *r);
+
+/**
+ * Give the shell back the streams saved by redirect_apply() and close
+ * the files of the redirections.
+ *
+ * @return 0, if the function finished successfully
+ *		  -1, else
+ */
+int redirect_restore(struct redirect *r);
+
+/**
+ * Close the files of the redirections (e.g. once the command was spawned).
+ */
+void redirect_close(struct redirect *r);
+
+#endif /* _REDIRECT_H */
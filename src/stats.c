@@ -0,0 +1,156 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+#include "my_stdio.h"
+
+/* Bucket i holds the latencies below 2^i microseconds. */
+#define NR_BUCKETS		32
+
+struct histogram {
+	uint64_t count;
+	uint64_t sum_ns;
+	uint64_t buckets[NR_BUCKETS];
+};
+
+uint64_t stat_counters[NR_STAT_COUNTERS];
+static struct histogram histograms[NR_STAT_HISTOGRAMS];
+
+static const char * const counter_names[NR_STAT_COUNTERS] = {
+	[STAT_FORKS] = "forks",
+	[STAT_EXECS] = "execs",
+	[STAT_EXEC_FAILURES] = "exec_failures",
+	[STAT_BUILTINS] = "builtins",
+	[STAT_PIPES] = "pipes",
+	[STAT_DUP2] = "dup2",
+	[STAT_WRITES] = "writes",
+	[STAT_ARGV_BYTES] = "argv_bytes",
+	[STAT_ENV_LOOKUPS] = "env_lookups",
+	[STAT_MMAPS] = "mmaps",
+	[STAT_PARSE_NS] = "parse_ns",
+};
+
+static const char * const histogram_names[NR_STAT_HISTOGRAMS] = {
+	[STAT_PROMPT_LATENCY] = "prompt_latency",
+	[STAT_CHILD_LATENCY] = "child_latency",
+};
+
+uint64_t stat_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void stat_record(enum stat_histogram histogram, uint64_t ns)
+{
+	struct histogram *h = &histograms[histogram];
+	uint64_t us = ns / 1000;
+	int bucket = 0;
+
+	while (us && bucket < NR_BUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	h->count++;
+	h->sum_ns += ns;
+	h->buckets[bucket]++;
+}
+
+/* The report is built in memory and written at once. */
+struct report {
+	char buff[16 * 1024];
+	size_t len;
+};
+
+/*****
+ * Append formatted text to the report (it is cut when it is full).
+ *****/
+static void put(struct report *r, const char *format, ...)
+{
+	size_t left = sizeof(r->buff) - r->len;
+	va_list args;
+	int n;
+
+	va_start(args, format);
+	n = vsnprintf(r->buff + r->len, left, format, args);
+	va_end(args);
+
+	if (n > 0)
+		r->len += (size_t)n < left ? (size_t)n : left - 1;
+}
+
+/*****
+ * Print the counters and histograms as text.
+ *****/
+static void put_text(struct report *r)
+{
+	for (int i = 0; i < NR_STAT_COUNTERS; ++i)
+		put(r, "%-16s%llu\n", counter_names[i], (unsigned long long)stat_counters[i]);
+
+	for (int i = 0; i < NR_STAT_HISTOGRAMS; ++i) {
+		struct histogram *h = &histograms[i];
+
+		put(r, "%-16s%llu samples", histogram_names[i], (unsigned long long)h->count);
+		if (h->count)
+			put(r, ", mean %.3f ms", h->sum_ns / 1e6 / h->count);
+		put(r, "\n");
+
+		for (int b = 0; b < NR_BUCKETS; ++b)
+			if (h->buckets[b])
+				put(r, "%16s<%10lluus  %llu\n", "",
+				    1ULL << b, (unsigned long long)h->buckets[b]);
+	}
+}
+
+/*****
+ * Print the counters and histograms as a JSON object.
+ *****/
+static void put_json(struct report *r)
+{
+	put(r, "{\"counters\":{");
+	for (int i = 0; i < NR_STAT_COUNTERS; ++i)
+		put(r, "%s\"%s\":%llu", i ? "," : "", counter_names[i],
+		    (unsigned long long)stat_counters[i]);
+
+	put(r, "},\"histograms\":{");
+	for (int i = 0; i < NR_STAT_HISTOGRAMS; ++i) {
+		struct histogram *h = &histograms[i];
+		bool first = true;
+
+		put(r, "%s\"%s\":{\"count\":%llu,\"sum_ns\":%llu,\"buckets_us\":{",
+		    i ? "," : "", histogram_names[i],
+		    (unsigned long long)h->count, (unsigned long long)h->sum_ns);
+		for (int b = 0; b < NR_BUCKETS; ++b)
+			if (h->buckets[b]) {
+				put(r, "%s\"%llu\":%llu", first ? "" : ",", 1ULL << b,
+				    (unsigned long long)h->buckets[b]);
+				first = false;
+			}
+		put(r, "}}");
+	}
+	put(r, "}}\n");
+}
+
+void stats_print(int fd, bool json)
+{
+	struct report r = { .len = 0 };
+
+	if (json)
+		put_json(&r);
+	else
+		put_text(&r);
+	my_fwrite(r.buff, r.len, 1, fd);
+}
+
+void stats_reset(void)
+{
+	memset(stat_counters, 0, sizeof(stat_counters));
+	memset(histograms, 0, sizeof(histograms));
+}
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Counters kept for the whole session and printed by the stats builtin.
+ * A counter is a plain increment, so it can be updated on the hot paths.
+ * The counters of a forked child are lost when it exits.
+ */
+
+enum stat_counter {
+	STAT_FORKS,
+	STAT_EXECS,
+	STAT_EXEC_FAILURES,
+	/* Commands run by a builtin, without fork or exec. */
+	STAT_BUILTINS,
+	STAT_PIPES,
+	STAT_DUP2,
+	/* System calls which wrote the output of the shell (see my_stdio.h). */
+	STAT_WRITES,
+	STAT_ARGV_BYTES,
+	STAT_ENV_LOOKUPS,
+	STAT_MMAPS,
+	STAT_PARSE_NS,
+	NR_STAT_COUNTERS
+};
+
+/* Latency histograms, with power of two buckets of microseconds. */
+enum stat_histogram {
+	/* From one prompt to the next one. */
+	STAT_PROMPT_LATENCY,
+	/* From the start of a child until it is reaped. */
+	STAT_CHILD_LATENCY,
+	NR_STAT_HISTOGRAMS
+};
+
+extern uint64_t stat_counters[NR_STAT_COUNTERS];
+
+#define stat_add(counter, n)	(stat_counters[counter] += (n))
+#define stat_inc(counter)	stat_add(counter, 1)
+
+/**
+ * @return the current time, in nanoseconds (CLOCK_MONOTONIC)
+ */
+uint64_t stat_now(void);
+
+/**
+ * Add a latency to a histogram.
+ *
+ * @param ns the latency, in nanoseconds
+ */
+void stat_record(enum stat_histogram histogram, uint64_t ns);
+
+/**
+ * Print the counters and the histograms.
+ *
+ * @param fd file in which they are printed
+ * @param json whether to print them as a JSON object
+ */
+void stats_print(int fd, bool json);
+
+/**
+ * Set all the counters and histograms to 0.
+ */
+void stats_reset(void);
+
+#endif /* _STATS_H */
@@ -0,0 +1,118 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "trace.h"
+#include "env.h"
+#include "my_stdio.h"
+
+#define TRACE_BUFFER_SIZE	(64 * 1024)
+/* Longest event; a longer name is cut. */
+#define MAX_EVENT_SIZE		512
+#define MAX_NAME_SIZE		256
+
+/* -1, if tracing is off. */
+static int trace_fd = -1;
+static char buffer[TRACE_BUFFER_SIZE];
+static size_t len;
+static int pid;
+static int tid;
+
+void trace_init(void)
+{
+	const char *path = env_get(TRACE_ENV);
+
+	if (!path || !path[0])
+		return;
+
+	trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+	if (trace_fd == -1)
+		return;
+
+	my_fwrite("[\n", 2, 1, trace_fd);
+	pid = getpid();
+	tid = gettid();
+}
+
+uint64_t trace_start(void)
+{
+	struct timespec now;
+
+	if (trace_fd == -1)
+		return 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/*****
+ * Copy a string into a JSON string, without the quotes.
+ *
+ * @return the number of bytes written in out (at most MAX_NAME_SIZE)
+ *****/
+static size_t escape(char *out, const char *str)
+{
+	size_t pos = 0;
+
+	for (; *str && pos + 6 < MAX_NAME_SIZE; ++str) {
+		unsigned char c = *str;
+
+		if (c == '"' || c == '\\') {
+			out[pos++] = '\\';
+			out[pos++] = c;
+		} else if (c < 0x20) {
+			pos += snprintf(out + pos, 7, "\\u%04x", c);
+		} else {
+			out[pos++] = c;
+		}
+	}
+	return pos;
+}
+
+void trace_end(const char *cat, const char *name, int level, uint64_t start)
+{
+	if (trace_fd == -1 || !start)
+		return;
+
+	uint64_t end = trace_start();
+	char escaped[MAX_NAME_SIZE];
+	size_t name_len = escape(escaped, name ? name : "");
+
+	if (len + MAX_EVENT_SIZE > sizeof(buffer))
+		trace_flush();
+
+	/* The timestamps are in microseconds. */
+	len += snprintf(buffer + len, MAX_EVENT_SIZE,
+			"{\"name\":\"%.*s\",\"cat\":\"%s\",\"ph\":\"X\","
+			"\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,\"pid\":%d,\"tid\":%d,"
+			"\"args\":{\"level\":%d}},\n",
+			(int)name_len, escaped, cat,
+			(unsigned long long)(start / 1000), (unsigned long long)(start % 1000),
+			(unsigned long long)((end - start) / 1000),
+			(unsigned long long)((end - start) % 1000),
+			pid, tid, level);
+}
+
+void trace_flush(void)
+{
+	if (trace_fd == -1 || !len)
+		return;
+
+	my_fwrite(buffer, len, 1, trace_fd);
+	len = 0;
+}
+
+void trace_forget(void)
+{
+	if (trace_fd == -1)
+		return;
+
+	len = 0;
+	pid = getpid();
+	tid = gettid();
+}
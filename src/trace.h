@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+/*
+ * Execution timeline. When MINISHELL_TRACE names a file, the shell and
+ * its forked children append Chrome trace events to it (JSON array
+ * format, without the optional closing ']'), so that the file can be
+ * opened in Perfetto or chrome://tracing. The events are buffered and
+ * written with one write() per buffer; a process must call trace_flush()
+ * before it exits or execs.
+ */
+
+#define TRACE_ENV		"MINISHELL_TRACE"
+
+/**
+ * Open the trace file, if MINISHELL_TRACE is set. It must be called once,
+ * by the shell, before any other trace function.
+ */
+void trace_init(void);
+
+/**
+ * @return the start of an event (0, if tracing is off)
+ */
+uint64_t trace_start(void);
+
+/**
+ * Add an event which lasted from start until now.
+ *
+ * @param cat the category of the event (e.g. "exec")
+ * @param name the name of the event (it may be any string)
+ * @param level the level of the command in the parse tree
+ * @param start the value returned by trace_start()
+ */
+void trace_end(const char *cat, const char *name, int level, uint64_t start);
+
+/**
+ * Write the buffered events.
+ */
+void trace_flush(void);
+
+/**
+ * Drop the events inherited from the parent (they are written by the
+ * parent). It must be called in a forked child.
+ */
+void trace_forget(void);
+
+#endif /* _TRACE_H */
@@ -5,41 +5,40 @@
 #include <string.h>
 
 #include "utils.h"
+#include "env.h"
+#include "my_string.h"
+
+static const char * const op_text[OP_DUMMY] = {
+	[OP_SEQUENTIAL] = " ; ",
+	[OP_PARALLEL] = " & ",
+	[OP_CONDITIONAL_ZERO] = " && ",
+	[OP_CONDITIONAL_NZERO] = " || ",
+	[OP_PIPE] = " | ",
+	[OP_BACKGROUND] = " &",
+};
 
 /**
  * Concatenate parts of the word to obtain the command.
  */
 char *get_word(word_t *s)
 {
-	char *string = NULL;
-	int string_length = 0;
+	size_t size = 1;
+	struct my_str str;
+	char *string;
 
-	const char *substring = NULL;
-	int substring_length = 0;
+	if (s == NULL)
+		return NULL;
 
-	while (s != NULL) {
-		if (s->expand == true) {
-			substring = getenv(s->string);
+	/* The parts are measured first, so the word is copied only once. */
+	for (word_t *part = s; part != NULL; part = part->next_part)
+		size += my_strlen(part->expand ? env_get(part->string) : part->string);
 
-			/* Prevents strlen from failing. */
-			if (substring == NULL)
-				substring = "";
-		} else {
-			substring = s->string;
-		}
+	string = malloc(size);
+	DIE(string == NULL, "Error allocating word string.");
 
-		substring_length = strlen(substring);
-
-		string = realloc(string, string_length + substring_length + 1);
-		DIE(string == NULL, "Error allocating word string.");
-
-		string[string_length] = '\0';
-		strcat(string, substring);
-
-		string_length += substring_length;
-
-		s = s->next_part;
-	}
+	my_str_init(&str, string, size);
+	for (; s != NULL; s = s->next_part)
+		my_str_append(&str, s->expand ? env_get(s->string) : s->string);
 
 	return string;
 }
@@ -84,3 +83,88 @@ char **get_argv(simple_command_t *command, int *size)
 
 	return argv;
 }
+
+/*****
+ * Append a string to a text which is being built.
+ *
+ * @param buf the text (NULL, to only count its length)
+ * @param pos the length of the text so far
+ * @return the length of the text after the string
+ *****/
+static size_t put_text(char *buf, size_t pos, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (buf)
+		memcpy(buf + pos, str, len);
+	return pos + len;
+}
+
+/*****
+ * Append a word to a text, with '$' before the parts which are expanded.
+ *****/
+static size_t put_word(char *buf, size_t pos, word_t *word)
+{
+	for (; word; word = word->next_part) {
+		if (word->expand)
+			pos = put_text(buf, pos, "$");
+		pos = put_text(buf, pos, word->string);
+	}
+	return pos;
+}
+
+/*****
+ * Append a command to a text, as it would be typed.
+ *****/
+static size_t put_command(char *buf, size_t pos, command_t *c)
+{
+	if (c->op != OP_NONE) {
+		pos = put_command(buf, pos, c->cmd1);
+		pos = put_text(buf, pos, op_text[c->op]);
+		/* OP_BACKGROUND has no second command. */
+		return c->cmd2 ? put_command(buf, pos, c->cmd2) : pos;
+	}
+
+	simple_command_t *s = c->scmd;
+
+	pos = put_word(buf, pos, s->verb);
+	for (word_t *param = s->params; param; param = param->next_word) {
+		pos = put_text(buf, pos, " ");
+		pos = put_word(buf, pos, param);
+	}
+	if (s->in) {
+		pos = put_text(buf, pos, " < ");
+		pos = put_word(buf, pos, s->in);
+	}
+	/* A copy of where a stream went comes before the files. */
+	if (IO_ERR_TARGET(s->io_flags) == IO_TO_OLD_OUT)
+		pos = put_text(buf, pos, " 2>&1");
+	if (IO_OUT_TARGET(s->io_flags) == IO_TO_OLD_ERR)
+		pos = put_text(buf, pos, " >&2");
+	if (s->out) {
+		pos = put_text(buf, pos, s->io_flags & IO_OUT_APPEND ? " >> " : " > ");
+		pos = put_word(buf, pos, s->out);
+	}
+	if (s->err) {
+		pos = put_text(buf, pos, s->io_flags & IO_ERR_APPEND ? " 2>> " : " 2> ");
+		pos = put_word(buf, pos, s->err);
+	}
+	if (IO_ERR_TARGET(s->io_flags) == IO_TO_OTHER)
+		pos = put_text(buf, pos, " 2>&1");
+	if (IO_OUT_TARGET(s->io_flags) == IO_TO_OTHER)
+		pos = put_text(buf, pos, " >&2");
+	return pos;
+}
+
+char *get_command_text(command_t *c)
+{
+	size_t len = put_command(NULL, 0, c);
+	char *text = malloc(len + 1);
+
+	if (!text)
+		return NULL;
+	put_command(text, 0, c);
+	text[len] = '\0';
+
+	return text;
+}
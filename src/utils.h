@@ -28,4 +28,12 @@ char *get_word(word_t *s);
  */
 char **get_argv(simple_command_t *command, int *size);
 
+/**
+ * Write a command as it would be typed (e.g. "ls -l $HOME | wc -l").
+ *
+ * @return the text, allocated with malloc
+ *		   NULL, if the allocation failed
+ */
+char *get_command_text(command_t *c);
+
 #endif /* _UTILS_H */
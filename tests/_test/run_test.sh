@@ -190,7 +190,7 @@ test_common_alt() {
 	fi
 }
 
-# Test 18.
+# Tests 18 to 21, which compare the output with a ref file.
 test_exec_failed() {
 	init_test
 
@@ -222,6 +222,9 @@ test_fun_array=(
 	test_common_alt "Testing sleep command" 7
 	test_common_alt "Testing fscanf function" 7
 	test_exec_failed "Testing unknown command" 4
+	test_exec_failed "Testing unknown command on the last line" 0
+	test_exec_failed "Testing the text of a background job" 0
+	test_exec_failed "Testing the order of the redirections" 0
 )
 
 # ----------------- Run test ------------------------------------------------- #
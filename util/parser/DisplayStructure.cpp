@@ -55,6 +55,16 @@ static void displayList(word_t * w, int level)
 }
 
 
+static const char * targetName(int target, const char * other)
+{
+	switch (target) {
+	case IO_TO_OTHER:	return other;
+	case IO_TO_OLD_OUT:	return "old out";
+	default:		return "old err";
+	}
+}
+
+
 static void displaySimple(simple_command_t * s, int level, command_t * father)
 {
 	assert(s != NULL);
@@ -95,6 +105,14 @@ static void displaySimple(simple_command_t * s, int level, command_t * father)
 		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
 	}
 
+	if (IO_ERR_TARGET(s->io_flags) != IO_TO_FILE)
+		std::cout << std::setw(2 * indent * level + indent) << "" << "err = "
+			  << targetName(IO_ERR_TARGET(s->io_flags), "out") << std::endl;
+
+	if (IO_OUT_TARGET(s->io_flags) != IO_TO_FILE)
+		std::cout << std::setw(2 * indent * level + indent) << "" << "out = "
+			  << targetName(IO_OUT_TARGET(s->io_flags), "err") << std::endl;
+
 	std::cout << std::setw(2 * indent * level) << "" << ")" << std::endl;
 }
 
@@ -131,6 +149,9 @@ static void displayCommand(command_t * c, int level, command_t * father)
 		case OP_PIPE:
 			std::cout << "OP_PIPE";
 			break;
+		case OP_BACKGROUND:
+			std::cout << "OP_BACKGROUND";
+			break;
 		default:
 			assert(false);
 		}
@@ -139,9 +160,13 @@ static void displayCommand(command_t * c, int level, command_t * father)
 		std::cout << std::setw(2 * indent * level + indent) << "" << "cmd1 (" << std::endl;
 		displayCommand(c->cmd1, level + 1, c);
 		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
-		std::cout << std::setw(2 * indent * level + indent) << "" << "cmd2 (" << std::endl;
-		displayCommand(c->cmd2, level + 1, c);
-		std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+		if (c->op == OP_BACKGROUND) {
+			assert(c->cmd2 == NULL);
+		} else {
+			std::cout << std::setw(2 * indent * level + indent) << "" << "cmd2 (" << std::endl;
+			displayCommand(c->cmd2, level + 1, c);
+			std::cout << std::setw(2 * indent * level + indent) << "" << ")" << std::endl;
+		}
 	}
 
 	std::cout << std::setw(2 * indent * level) << "" << ")" << std::endl;
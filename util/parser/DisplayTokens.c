@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: BSD-3-Clause
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "./parser.h"
+#include "./parser.tab.h"
+
+#ifdef UNICODE
+#  error "Unicode not supported in this source file!"
+#endif
+
+#define PROMPT_STRING	"> "
+#define MAX_CMD_LEN		4096
+/* a lexer which never returns END_OF_FILE is stopped after so many tokens */
+#define MAX_TOKENS		1024
+
+
+void parse_error(const char *str, const int where)
+{
+	fprintf(stderr, "Parse error near %d: %s\n", where, str);
+}
+
+
+static const char *tokenName(int token)
+{
+	switch (token) {
+	case NOT_ACCEPTED_CHAR:		return "NOT_ACCEPTED_CHAR";
+	case INVALID_ENVIRONMENT_VAR:	return "INVALID_ENVIRONMENT_VAR";
+	case UNEXPECTED_EOF:		return "UNEXPECTED_EOF";
+	case CHARS_AFTER_EOL:		return "CHARS_AFTER_EOL";
+	case END_OF_FILE:		return "END_OF_FILE";
+	case END_OF_LINE:		return "END_OF_LINE";
+	case BLANK:			return "BLANK";
+	case REDIRECT_OE:		return "REDIRECT_OE";
+	case REDIRECT_O:		return "REDIRECT_O";
+	case REDIRECT_E:		return "REDIRECT_E";
+	case INDIRECT:			return "INDIRECT";
+	case REDIRECT_APPEND_E:		return "REDIRECT_APPEND_E";
+	case REDIRECT_APPEND_O:		return "REDIRECT_APPEND_O";
+	case WORD:			return "WORD";
+	case ENV_VAR:			return "ENV_VAR";
+	case SEQUENTIAL:		return "SEQUENTIAL";
+	case PARALLEL:			return "PARALLEL";
+	case CONDITIONAL_NZERO:		return "CONDITIONAL_NZERO";
+	case CONDITIONAL_ZERO:		return "CONDITIONAL_ZERO";
+	case PIPE:			return "PIPE";
+	default:			return "UNKNOWN";
+	}
+}
+
+
+/*
+ * Reads commands (one per line) and displays the tokens returned by the
+ * lexer for each of them, with their locations; the output of parser.l
+ * and of lexer.c must be the same (see "make compare_lexers").
+ */
+int main(void)
+{
+	char line[MAX_CMD_LEN];
+	parse_context_t *ctx = new_parse_context();
+	void *scanner = ctx ? newScanner(ctx) : NULL;
+
+	if (scanner == NULL) {
+		fprintf(stderr, "Out of memory!\n");
+		return EXIT_FAILURE;
+	}
+
+	for (;;) {
+		/* the same start as the one of the parser (%initial-action) */
+		YYLTYPE lloc = { .first_line = 1, .last_line = 1 };
+		YYSTYPE lval;
+		int token = 0;
+
+		printf(PROMPT_STRING);
+		if (fgets(line, sizeof(line), stdin) == NULL)
+			break;
+
+		printf("%s", line);
+		scanString(scanner, line);
+
+		for (int i = 0; i < MAX_TOKENS && token != END_OF_FILE &&
+		     token != UNEXPECTED_EOF; ++i) {
+			token = yylex(&lval, &lloc, scanner);
+			printf("%d.%d-%d.%d %s", lloc.first_line, lloc.first_column,
+			       lloc.last_line, lloc.last_column, tokenName(token));
+			if (token == WORD || token == ENV_VAR)
+				printf(" '%s'", lval.string_un);
+			printf("\n");
+		}
+
+		printf("\n");
+		free_parse_memory_r(ctx);
+	}
+
+	fprintf(stderr, "End of file!\n");
+	freeScanner(scanner);
+	free_parse_context(ctx);
+	return EXIT_SUCCESS;
+}
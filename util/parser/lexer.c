@@ -0,0 +1,367 @@
+/*
+ * Hand-written lexer, built instead of the one generated from parser.l
+ * with "make LEXER=simd". It returns the same tokens, with the same
+ * locations, but it reads the line in place instead of copying it into a
+ * flex buffer, and it finds the end of the long tokens (words, blanks,
+ * quoted text) 16 bytes at a time with SSE2.
+ *
+ * The rules below are those of parser.l, in the same order; a comment
+ * gives the flex pattern of every token. The lexer is reentrant: all its
+ * state is in the scanner of a parse context.
+ */
+
+
+#ifdef __cplusplus
+
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define __PARSER_H_INTERNAL_INCLUDE
+#include "parser.h"
+#include "parser.tab.h"
+
+
+/* Bytes of a parameterValue, besides the letters and the digits. */
+#define WORD_PUNCTUATION	"-\\+:._%?*~/,"
+
+/* Classes of the bytes, as in parser.l */
+#define CLASS_WORD		0x01	/* parameterValue */
+#define CLASS_NAME_START	0x02	/* first byte of envVarName */
+#define CLASS_NAME		0x04	/* other bytes of envVarName */
+#define CLASS_BLANK		0x08	/* whitespace */
+#define CLASS_QUOTED		0x10	/* allButCharStateAny */
+#define CLASS_EXPANDED		0x20	/* allButCharStateAnyAndExpansion */
+
+/* The quote rules return no token, they only change the state. */
+#define NO_TOKEN		-1
+
+/*
+ * The table of the classes is a constant, so the scanners of several
+ * threads can share it.
+ */
+#define IS_LETTER(i)		(((i) >= 'a' && (i) <= 'z') || ((i) >= 'A' && (i) <= 'Z'))
+#define IS_DIGIT(i)		((i) >= '0' && (i) <= '9')
+#define IS_PUNCTUATION(i) \
+	((i) == '-' || (i) == '\\' || (i) == '+' || (i) == ':' || (i) == '.' || \
+	 (i) == '_' || (i) == '%' || (i) == '?' || (i) == '*' || (i) == '~' || \
+	 (i) == '/' || (i) == ',')
+#define CLASSES(i) \
+	((IS_LETTER(i) || IS_DIGIT(i) || IS_PUNCTUATION(i) ? CLASS_WORD : 0) | \
+	 (IS_LETTER(i) || (i) == '_' ? CLASS_NAME_START : 0) | \
+	 (IS_LETTER(i) || IS_DIGIT(i) || (i) == '_' ? CLASS_NAME : 0) | \
+	 ((i) == ' ' || (i) == '\t' ? CLASS_BLANK : 0) | \
+	 ((i) != '\'' ? CLASS_QUOTED : 0) | \
+	 ((i) != '"' && (i) != '$' ? CLASS_EXPANDED : 0))
+#define CLASSES_4(i)		CLASSES(i), CLASSES(i + 1), CLASSES(i + 2), CLASSES(i + 3)
+#define CLASSES_16(i)		CLASSES_4(i), CLASSES_4(i + 4), CLASSES_4(i + 8), CLASSES_4(i + 12)
+#define CLASSES_64(i)		CLASSES_16(i), CLASSES_16(i + 16), CLASSES_16(i + 32), \
+				CLASSES_16(i + 48)
+
+static const unsigned char classes[256] = {
+	CLASSES_64(0), CLASSES_64(64), CLASSES_64(128), CLASSES_64(192)
+};
+
+typedef enum {
+	STATE_INITIAL,
+	STATE_ACCEPT_ANY,
+	STATE_ACCEPT_ANY_AND_EXPANSION
+} lexer_state_t;
+
+typedef struct {
+	parse_context_t * ctx;
+	/* the rest of the line; it ends at input_end, on its null byte */
+	const char * input;
+	const char * input_end;
+	lexer_state_t state;
+	/* the arguments of the current call of yylex() */
+	YYSTYPE * lval;
+	YYLTYPE * lloc;
+} scanner_t;
+
+
+#ifdef __SSE2__
+
+/* The bytes of v between lo and hi (SSE2 has only signed compares). */
+static __m128i in_range(__m128i v, char lo, char hi)
+{
+	__m128i shifted = _mm_add_epi8(v, _mm_set1_epi8((char)(128 - lo)));
+
+	return _mm_cmplt_epi8(shifted, _mm_set1_epi8((char)(-128 + (hi - lo) + 1)));
+}
+
+
+/* One bit for each of the 16 bytes of v which are not in the class. */
+static unsigned int outside_class(__m128i v, unsigned char cls)
+{
+	__m128i in;
+	const char * c;
+
+	switch (cls) {
+	case CLASS_BLANK:
+		in = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+				  _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+		return _mm_movemask_epi8(in) ^ 0xffff;
+
+	case CLASS_QUOTED:
+		return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+
+	case CLASS_EXPANDED:
+		return _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+						      _mm_cmpeq_epi8(v, _mm_set1_epi8('$'))));
+
+	default:
+		/* CLASS_WORD; "| 0x20" makes the upper case letters lower case */
+		in = _mm_or_si128(in_range(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z'),
+				  in_range(v, '0', '9'));
+		for (c = WORD_PUNCTUATION; *c; c++)
+			in = _mm_or_si128(in, _mm_cmpeq_epi8(v, _mm_set1_epi8(*c)));
+		return _mm_movemask_epi8(in) ^ 0xffff;
+	}
+}
+
+#endif
+
+
+/* The end of the run of bytes of a class which starts at p. */
+static const char * skip_class(const char * p, const char * end, unsigned char cls)
+{
+#ifdef __SSE2__
+	while (end - p >= 16) {
+		unsigned int mask = outside_class(_mm_loadu_si128((const __m128i *)p), cls);
+
+		if (mask)
+			return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+
+	while (p < end && (classes[(unsigned char)*p] & cls))
+		p++;
+	return p;
+}
+
+
+/* Consume the next len bytes, which make a token (UPD_LOCATION). */
+static int token(scanner_t * s, int type, size_t len)
+{
+	s->lloc->first_column = s->lloc->last_column;
+	s->lloc->last_column += (int)len;
+	s->input += len;
+	return type;
+}
+
+
+/* A token with a string: the string is copied, the token is len bytes. */
+static int string_token(scanner_t * s, int type, const char * str, size_t str_len, size_t len)
+{
+	s->lval->string_un = copyParseString(s->ctx, str, str_len);
+	return token(s, type, len);
+}
+
+
+/* {substitutionCharacter}{envVarName} or {substitutionCharacter} */
+static int variable(scanner_t * s)
+{
+	const char * input = s->input;
+	const char * end;
+
+	if (!(classes[(unsigned char)input[1]] & CLASS_NAME_START))
+		return token(s, INVALID_ENVIRONMENT_VAR, 1);
+
+	for (end = input + 2; classes[(unsigned char)*end] & CLASS_NAME; end++)
+		;
+	return string_token(s, ENV_VAR, input + 1, end - input - 1, end - input);
+}
+
+
+static int lex_initial(scanner_t * s)
+{
+	const char * input = s->input;
+	const char * end;
+	size_t len;
+
+	if (input == s->input_end)
+		return END_OF_FILE;
+
+	switch (*input) {
+	case '\r':
+		if (input[1] != '\n')
+			break;
+		/* fallthrough */
+	case '\n':
+		/* {newLine}{anyChar} or {newLine} */
+		len = *input == '\r' ? 2 : 1;
+		if (input + len < s->input_end)
+			return token(s, CHARS_AFTER_EOL, len + 1);
+		return token(s, END_OF_LINE, len);
+
+	case '\'':
+		token(s, NO_TOKEN, 1);
+		s->state = STATE_ACCEPT_ANY;
+		return NO_TOKEN;
+
+	case '"':
+		token(s, NO_TOKEN, 1);
+		s->state = STATE_ACCEPT_ANY_AND_EXPANSION;
+		return NO_TOKEN;
+
+	case ';':
+		return token(s, SEQUENTIAL, 1);
+
+	case '|':
+		if (input[1] == '|')
+			return token(s, CONDITIONAL_NZERO, 2);
+		return token(s, PIPE, 1);
+
+	case '&':
+		if (input[1] == '&')
+			return token(s, CONDITIONAL_ZERO, 2);
+		if (input[1] == '>')
+			return token(s, REDIRECT_OE, 2);
+		return token(s, PARALLEL, 1);
+
+	case '2':
+		/* longer than the parameterValue "2" */
+		if (input[1] != '>')
+			break;
+		if (input[2] == '>')
+			return token(s, REDIRECT_APPEND_E, 3);
+		return token(s, REDIRECT_E, 2);
+
+	case '>':
+		if (input[1] == '>')
+			return token(s, REDIRECT_APPEND_O, 2);
+		return token(s, REDIRECT_O, 1);
+
+	case '<':
+		return token(s, INDIRECT, 1);
+
+	case ' ':
+	case '\t':
+		end = skip_class(input, s->input_end, CLASS_BLANK);
+		return token(s, BLANK, end - input);
+
+	case '=':
+		return string_token(s, WORD, input, 1, 1);
+
+	case '$':
+		return variable(s);
+
+	default:
+		break;
+	}
+
+	if (!(classes[(unsigned char)*input] & CLASS_WORD))
+		return token(s, NOT_ACCEPTED_CHAR, 1);
+
+	end = skip_class(input, s->input_end, CLASS_WORD);
+	return string_token(s, WORD, input, end - input, end - input);
+}
+
+
+/* {allButCharStateAny}* in ACCEPT_ANY */
+static int lex_accept_any(scanner_t * s)
+{
+	const char * input = s->input;
+	const char * end;
+
+	if (input == s->input_end)
+		return UNEXPECTED_EOF;
+
+	if (*input == '\'') {
+		token(s, NO_TOKEN, 1);
+		s->state = STATE_INITIAL;
+		return NO_TOKEN;
+	}
+
+	end = skip_class(input, s->input_end, CLASS_QUOTED);
+	return string_token(s, WORD, input, end - input, end - input);
+}
+
+
+/* {allButCharStateAnyAndExpansion}* and variables in ACCEPT_ANY_AND_EXPANSION */
+static int lex_accept_any_and_expansion(scanner_t * s)
+{
+	const char * input = s->input;
+	const char * end;
+
+	if (input == s->input_end)
+		return UNEXPECTED_EOF;
+
+	if (*input == '"') {
+		token(s, NO_TOKEN, 1);
+		s->state = STATE_INITIAL;
+		return NO_TOKEN;
+	}
+
+	if (*input == '$')
+		return variable(s);
+
+	end = skip_class(input, s->input_end, CLASS_EXPANDED);
+	return string_token(s, WORD, input, end - input, end - input);
+}
+
+
+int yylex(YYSTYPE * lval, YYLTYPE * lloc, void * scanner)
+{
+	scanner_t * s = (scanner_t *)scanner;
+	int type;
+
+	s->lval = lval;
+	s->lloc = lloc;
+
+	do {
+		switch (s->state) {
+		case STATE_ACCEPT_ANY:
+			type = lex_accept_any(s);
+			break;
+		case STATE_ACCEPT_ANY_AND_EXPANSION:
+			type = lex_accept_any_and_expansion(s);
+			break;
+		default:
+			type = lex_initial(s);
+			break;
+		}
+	} while (type == NO_TOKEN);
+
+	return type;
+}
+
+
+void * newScanner(parse_context_t * ctx)
+{
+	scanner_t * s = (scanner_t *)calloc(1, sizeof(scanner_t));
+
+	if (s != NULL)
+		s->ctx = ctx;
+	return s;
+}
+
+
+void scanString(void * scanner, const char * str)
+{
+	scanner_t * s = (scanner_t *)scanner;
+
+	s->input = str;
+	s->input_end = str + strlen(str);
+	s->state = STATE_INITIAL;
+}
+
+
+void freeScanner(void * scanner)
+{
+	free(scanner);
+}
@@ -92,6 +92,11 @@ typedef struct word_t {
  * any of these lists, the literals are in the original order.
 
  * io_flags is used to specify special modes for redirection (e.g. appending)
+ * and where stdout and stderr go after the duplications ("2>&1" and
+ * ">&2"), which are resolved in order: a duplication copies what the
+ * stream is at that point, so "cmd >out 2>&1" sends stderr to out and
+ * "cmd 2>&1 >out" sends it to the old stdout. A duplication of a stream
+ * to itself (e.g. "2>&2") is accepted and ignored
 
  * Some string literals can be found in both the out list and the err list
  * (those entered as "command &> out").
@@ -104,6 +109,20 @@ typedef struct word_t {
 #define IO_OUT_APPEND	0x01
 #define IO_ERR_APPEND	0x02
 
+/* Where stdout and stderr go: IO_OUT_TARGET(io_flags), IO_ERR_TARGET(io_flags). */
+#define IO_OUT_SHIFT	2
+#define IO_ERR_SHIFT	4
+#define IO_OUT_TARGET(flags)	(((flags) >> IO_OUT_SHIFT) & 0x03)
+#define IO_ERR_TARGET(flags)	(((flags) >> IO_ERR_SHIFT) & 0x03)
+/* The first file of the stream or, if it has none, where the stream went. */
+#define IO_TO_FILE	0
+/* The first file of the other stream ("2>&1" after ">out"), or where it went. */
+#define IO_TO_OTHER	1
+/* Where stdout went before the redirections (stderr of "2>&1 >out"). */
+#define IO_TO_OLD_OUT	2
+/* Where stderr went before the redirections (stdout of ">&2 2>err"). */
+#define IO_TO_OLD_ERR	3
+
 typedef struct {
 	word_t *verb;
 	word_t *params;
@@ -124,6 +143,9 @@ typedef struct {
 
  * The rest of the operators mean scmd == NULL
 
+ * OP_BACKGROUND (a trailing '&') is the only unary operator: cmd1 must be
+ * started without waiting for it and cmd2 == NULL
+
  * OP_DUMMY is a dummy value that can be used to count the number of operators
  */
 
@@ -134,6 +156,7 @@ typedef enum {
 	OP_CONDITIONAL_ZERO,
 	OP_CONDITIONAL_NZERO,
 	OP_PIPE,
+	OP_BACKGROUND,
 	OP_DUMMY
 } operator_t;
 
@@ -148,7 +171,7 @@ typedef enum {
  *  else
       scmd == NULL
       cmd1 != NULL
-      cmd2 != NULL
+      cmd2 != NULL (except for OP_BACKGROUND)
       cmd1 op cmd2 must be executed, according to the rules for op
 
  * You can use aux the same way as for simple_command_t
@@ -163,6 +186,7 @@ typedef enum {
  * parent in the tree with op == op_lower
  * In particular, if op == OP_PIPE descendants
  * can only have OP_PIPE or OP_NONE
+ * OP_BACKGROUND can only be the root of the tree
  */
 
 typedef struct command_t {
@@ -216,6 +240,30 @@ bool parse_line(const char *line, command_t **root);
 
 void free_parse_memory(void);
 
+
+/*
+ * Reentrant parser
+
+ * parse_line() and free_parse_memory() use a context of their own, so
+ * only one line can be parsed at a time and only the last tree is kept.
+ * A context made by new_parse_context() has its own memory and its own
+ * lexer: several contexts can hold their trees at the same time, and
+ * each one can be used on another thread (one thread per context).
+
+ * parse_line_r() and free_parse_memory_r() are parse_line() and
+ * free_parse_memory() for the tree of one context; the tree stays valid
+ * until the next call of either of them or free_parse_context()
+
+ * new_parse_context() returns NULL if there is no memory
+ */
+
+typedef struct parse_context_t parse_context_t;
+
+parse_context_t *new_parse_context(void);
+bool parse_line_r(parse_context_t *ctx, const char *line, command_t **root);
+void free_parse_memory_r(parse_context_t *ctx);
+void free_parse_context(parse_context_t *ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -227,8 +275,6 @@ void free_parse_memory(void);
  * Parser and lexer common internal stuff
  */
 
-typedef void *GenericPointer;
-
 typedef struct {
 	word_t *red_i;
 	word_t *red_o;
@@ -242,10 +288,16 @@ extern "C"
 {
 #endif
 
-void pointerToMallocMemory(const void *ptr);
-int yylex(void);
-void globalParseAnotherString(const char *str);
-void globalEndParsing(void);
+void *allocParseMemory(parse_context_t *ctx, size_t size);
+const char *copyParseString(parse_context_t *ctx, const char *str, size_t len);
+
+/*
+ * The lexer of a context (parser.l or lexer.c); yylex() is declared in
+ * parser.tab.h, its last argument is the scanner
+ */
+void *newScanner(parse_context_t *ctx);
+void scanString(void *scanner, const char *str);
+void freeScanner(void *scanner);
 
 #ifdef __cplusplus
 }
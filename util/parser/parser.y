@@ -1,5 +1,8 @@
 %defines
 %locations
+%define api.pure full
+%parse-param {parse_context_t * ctx} {void * scanner}
+%lex-param {void * scanner}
 %{
 
 
@@ -33,65 +36,193 @@ using namespace std;
 #include "parser.h"
 
 
-static GenericPointer * globalAllocMem = NULL;
-static size_t globalAllocCount = 0;
-static size_t globalAllocSize  = 0;
-static bool needsFree = false;
-static command_t * command_root = NULL;
+/*
+ * All the nodes of the parse tree and all the token strings are taken from
+ * an arena: a list of chunks from which memory is handed out in order.
+ * free_parse_memory_r() rewinds the arena and nothing is freed one by one.
+ * Only the first chunk is kept for the next line, so a long line does not
+ * keep its memory for the rest of the session. Every context has its own
+ * arena.
+ */
 
+#define PARSE_CHUNK_SIZE	(16 * 1024)
+#define PARSE_ALIGN		16
 
-void yyerror(const char* str);
+typedef struct parse_chunk_t {
+	struct parse_chunk_t * next;
+	size_t size;
+	size_t used;
+} parse_chunk_t;
 
+/* The chunks start after the header, rounded up to PARSE_ALIGN. */
+#define CHUNK_HEADER_SIZE \
+	((sizeof(parse_chunk_t) + PARSE_ALIGN - 1) & ~(size_t)(PARSE_ALIGN - 1))
 
-static void ensureSize(size_t newSize)
+struct parse_context_t {
+	parse_chunk_t * firstChunk;
+	parse_chunk_t * currentChunk;
+	bool needsFree;
+	command_t * root;
+	/* the lexer, for this context only */
+	void * scanner;
+};
+
+/* the context of parse_line() and free_parse_memory() */
+static parse_context_t * globalContext = NULL;
+
+
+static parse_chunk_t * newChunk(size_t size)
 {
-	GenericPointer * newPtr;
-	assert(newSize > 0);
-
-	if (globalAllocSize == 0) {
-		assert(globalAllocMem == NULL);
-		globalAllocSize = newSize;
-		globalAllocMem = (GenericPointer *)malloc(sizeof(GenericPointer) * globalAllocSize);
-		if (globalAllocMem == NULL) {
-			fprintf(stderr, "malloc() failed\n");
-			exit(EXIT_FAILURE);
-		}
+	parse_chunk_t * chunk;
 
-		return;
+	if (size < PARSE_CHUNK_SIZE)
+		size = PARSE_CHUNK_SIZE;
+
+	chunk = (parse_chunk_t *)malloc(CHUNK_HEADER_SIZE + size);
+	if (chunk == NULL) {
+		fprintf(stderr, "malloc() failed\n");
+		exit(EXIT_FAILURE);
 	}
 
-	assert(globalAllocMem != NULL);
-	if (globalAllocSize >= newSize) {
-		return;
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+
+static void freeChunks(parse_chunk_t * chunk)
+{
+	parse_chunk_t * next;
+
+	while (chunk != NULL) {
+		next = chunk->next;
+		free(chunk);
+		chunk = next;
 	}
+}
 
-	globalAllocSize += newSize;
-	newPtr = (GenericPointer *)realloc((void *)globalAllocMem, sizeof(GenericPointer) * globalAllocSize);
-	if (newPtr == NULL) {
-		fprintf(stderr, "realloc() failed\n");
-		exit(EXIT_FAILURE);
+
+void * allocParseMemory(parse_context_t * ctx, size_t size)
+{
+	parse_chunk_t * chunk;
+
+	size = (size + PARSE_ALIGN - 1) & ~(size_t)(PARSE_ALIGN - 1);
+
+	if (ctx->currentChunk == NULL) {
+		if (ctx->firstChunk == NULL)
+			ctx->firstChunk = newChunk(size);
+		ctx->currentChunk = ctx->firstChunk;
+		ctx->currentChunk->used = 0;
 	}
 
-	globalAllocMem = newPtr;
+	if (ctx->currentChunk->size - ctx->currentChunk->used < size) {
+		chunk = newChunk(size);
+		ctx->currentChunk->next = chunk;
+		ctx->currentChunk = chunk;
+	}
+
+	chunk = ctx->currentChunk;
+	chunk->used += size;
+	return (char *)chunk + CHUNK_HEADER_SIZE + chunk->used - size;
 }
 
 
-void pointerToMallocMemory(const void * ptr)
+const char * copyParseString(parse_context_t * ctx, const char * str, size_t len)
 {
-	if (ptr == NULL) {
-		fprintf(stderr, "malloc() failed\n");
-		exit(EXIT_FAILURE);
+	char * copy = (char *)allocParseMemory(ctx, len + 1);
+
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+
+/*
+ * Set where stdout (fd 1) or stderr (fd 2) goes (one of IO_TO_*).
+ */
+static void set_target(redirect_t * red, int fd, int target)
+{
+	int shift = fd == 1 ? IO_OUT_SHIFT : IO_ERR_SHIFT;
+
+	red->red_flags &= ~(0x03 << shift);
+	red->red_flags |= target << shift;
+}
+
+
+/*
+ * Where a copy of stdout (fd 1) or stderr (fd 2) made at this point of
+ * the redirections goes, for the other stream. A file of the stream which
+ * comes later changes the stream, not its copy ("2>&1 >out" copies the
+ * old stdout), except for a stream which has a file already (only the
+ * first file of a stream is used).
+ */
+static int copy_target(redirect_t * red, int fd)
+{
+	int target = fd == 1 ? IO_OUT_TARGET(red->red_flags) :
+			       IO_ERR_TARGET(red->red_flags);
+	word_t * files = fd == 1 ? red->red_o : red->red_e;
+
+	switch (target) {
+	case IO_TO_FILE:
+		if (files != NULL)
+			return IO_TO_OTHER;
+		return fd == 1 ? IO_TO_OLD_OUT : IO_TO_OLD_ERR;
+	case IO_TO_OTHER:
+		/* the stream goes to the file of the copy */
+		return IO_TO_FILE;
+	default:
+		return target;
 	}
+}
+
+
+/*
+ * Add the duplication "fd>&word" to the redirections of a command. Only
+ * stdout and stderr can be duplicated, so the word must be "1" or "2".
+ */
+static bool add_duplication(redirect_t * red, int fd, word_t * w)
+{
+	if (w->expand || w->next_part || strlen(w->string) != 1)
+		return false;
+
+	int target = w->string[0] - '0';
+
+	if (target != 1 && target != 2)
+		return false;
 
-	ensureSize(globalAllocCount + 1);
-	globalAllocMem[globalAllocCount++] = (GenericPointer)ptr;
+	if (target != fd)
+		set_target(red, fd, copy_target(red, target));
+	return true;
+}
+
+
+/*
+ * Once all the redirections are known, a stream which goes where a
+ * stream without a file went goes to that file instead, which is the
+ * same: "ls 2>&1" is "err = out" rather than "err = old out".
+ */
+static void simplify_targets(redirect_t * red)
+{
+	if (red->red_o == NULL) {
+		if (IO_OUT_TARGET(red->red_flags) == IO_TO_OLD_OUT)
+			set_target(red, 1, IO_TO_FILE);
+		if (IO_ERR_TARGET(red->red_flags) == IO_TO_OLD_OUT)
+			set_target(red, 2, IO_TO_OTHER);
+	}
+	if (red->red_e == NULL) {
+		if (IO_ERR_TARGET(red->red_flags) == IO_TO_OLD_ERR)
+			set_target(red, 2, IO_TO_FILE);
+		if (IO_OUT_TARGET(red->red_flags) == IO_TO_OLD_ERR)
+			set_target(red, 1, IO_TO_OTHER);
+	}
 }
 
 
-static simple_command_t * bind_parts(word_t * exe_name, word_t * params, redirect_t red)
+static simple_command_t * bind_parts(parse_context_t * ctx, word_t * exe_name,
+		word_t * params, redirect_t red)
 {
-	simple_command_t * s = (simple_command_t *) malloc(sizeof(simple_command_t));
-	pointerToMallocMemory(s);
+	simple_command_t * s = (simple_command_t *) allocParseMemory(ctx, sizeof(simple_command_t));
 
 	memset(s, 0, sizeof(*s));
 	assert(exe_name != NULL);
@@ -101,6 +232,7 @@ static simple_command_t * bind_parts(word_t * exe_name, word_t * params, redirec
 	s->in = red.red_i;
 	s->out = red.red_o;
 	s->err = red.red_e;
+	simplify_targets(&red);
 	s->io_flags = red.red_flags;
 	s->up = NULL;
 	s->aux = NULL;
@@ -108,15 +240,9 @@ static simple_command_t * bind_parts(word_t * exe_name, word_t * params, redirec
 }
 
 
-static command_t * new_command(simple_command_t * scmd)
+static command_t * new_command(parse_context_t * ctx, simple_command_t * scmd)
 {
-	command_t * c = (command_t *) malloc(sizeof(command_t));
-
-	if (c == NULL) {
-		fprintf(stderr, "malloc() failed\n");
-		exit(EXIT_FAILURE);
-	}
-	pointerToMallocMemory(c);
+	command_t * c = (command_t *) allocParseMemory(ctx, sizeof(command_t));
 
 	memset(c, 0, sizeof(*c));
 	c->up = c->cmd1 = c->cmd2 = NULL;
@@ -129,10 +255,10 @@ static command_t * new_command(simple_command_t * scmd)
 }
 
 
-static command_t * bind_commands(command_t * cmd1, command_t * cmd2, operator_t op)
+static command_t * bind_commands(parse_context_t * ctx, command_t * cmd1,
+		command_t * cmd2, operator_t op)
 {
-	command_t * c = (command_t *) malloc(sizeof(command_t));
-	pointerToMallocMemory(c);
+	command_t * c = (command_t *) allocParseMemory(ctx, sizeof(command_t));
 
 	memset(c, 0, sizeof(*c));
 	c->up = NULL;
@@ -154,10 +280,28 @@ static command_t * bind_commands(command_t * cmd1, command_t * cmd2, operator_t
 }
 
 
-static word_t * new_word(const char * str, bool expand)
+static command_t * background_command(parse_context_t * ctx, command_t * cmd)
+{
+	command_t * c = (command_t *) allocParseMemory(ctx, sizeof(command_t));
+
+	memset(c, 0, sizeof(*c));
+	c->up = NULL;
+	assert(cmd != NULL);
+	assert(cmd->up == NULL);
+	c->cmd1 = cmd;
+	cmd->up = c;
+	c->cmd2 = NULL;
+	c->op = OP_BACKGROUND;
+	c->scmd = NULL;
+	c->aux = NULL;
+
+	return c;
+}
+
+
+static word_t * new_word(parse_context_t * ctx, const char * str, bool expand)
 {
-	word_t * w = (word_t *) malloc(sizeof(word_t));
-	pointerToMallocMemory(w);
+	word_t * w = (word_t *) allocParseMemory(ctx, sizeof(word_t));
 
 	memset(w, 0, sizeof(*w));
 	assert(str != NULL);
@@ -232,6 +376,20 @@ static word_t * add_word_to_list(word_t * w, word_t * lst)
 	word_t * word_un;
 }
 
+%code provides {
+int yylex(YYSTYPE * lval, YYLTYPE * lloc, void * scanner);
+}
+
+%code {
+void yyerror(YYLTYPE * loc, parse_context_t * ctx, void * scanner, const char * str);
+}
+
+/* the columns start at 0, as for parse_error() */
+%initial-action {
+	@$.first_line = @$.last_line = 1;
+	@$.first_column = @$.last_column = 0;
+}
+
 
 %token NOT_ACCEPTED_CHAR INVALID_ENVIRONMENT_VAR UNEXPECTED_EOF CHARS_AFTER_EOL
 %token END_OF_FILE END_OF_LINE BLANK
@@ -259,32 +417,52 @@ static word_t * add_word_to_list(word_t * w, word_t * lst)
 command_tree:
 
 	  command END_OF_LINE {
-		command_root = $1;
+		ctx->root = $1;
 		YYACCEPT;
 	}
 
 	| command END_OF_FILE {
-		command_root = $1;
+		ctx->root = $1;
+		YYACCEPT;
+	}
+
+	| command PARALLEL END_OF_LINE {
+		ctx->root = background_command(ctx, $1);
+		YYACCEPT;
+	}
+
+	| command PARALLEL END_OF_FILE {
+		ctx->root = background_command(ctx, $1);
+		YYACCEPT;
+	}
+
+	| command PARALLEL BLANK END_OF_LINE {
+		ctx->root = background_command(ctx, $1);
+		YYACCEPT;
+	}
+
+	| command PARALLEL BLANK END_OF_FILE {
+		ctx->root = background_command(ctx, $1);
 		YYACCEPT;
 	}
 
 	| END_OF_LINE {
-		command_root = NULL;
+		ctx->root = NULL;
 		YYACCEPT;
 	}
 
 	| END_OF_FILE {
-		command_root = NULL;
+		ctx->root = NULL;
 		YYACCEPT;
 	}
 
 	| BLANK END_OF_LINE {
-		command_root = NULL;
+		ctx->root = NULL;
 		YYACCEPT;
 	}
 
 	| BLANK END_OF_FILE {
-		command_root = NULL;
+		ctx->root = NULL;
 		YYACCEPT;
 	}
 
@@ -293,27 +471,27 @@ command_tree:
 command:
 
 	  simple_command {
-		$$ = new_command($1);
+		$$ = new_command(ctx, $1);
 	}
 
 	| command SEQUENTIAL command {
-		$$ = bind_commands($1, $3, OP_SEQUENTIAL);
+		$$ = bind_commands(ctx, $1, $3, OP_SEQUENTIAL);
 	}
 
 	| command PARALLEL command {
-		$$ = bind_commands($1, $3, OP_PARALLEL);
+		$$ = bind_commands(ctx, $1, $3, OP_PARALLEL);
 	}
 
 	| command CONDITIONAL_ZERO command {
-		$$ = bind_commands($1, $3, OP_CONDITIONAL_ZERO);
+		$$ = bind_commands(ctx, $1, $3, OP_CONDITIONAL_ZERO);
 	}
 
 	| command CONDITIONAL_NZERO command {
-		$$ = bind_commands($1, $3, OP_CONDITIONAL_NZERO);
+		$$ = bind_commands(ctx, $1, $3, OP_CONDITIONAL_NZERO);
 	}
 
 	| command PIPE command {
-		$$ = bind_commands($1, $3, OP_PIPE);
+		$$ = bind_commands(ctx, $1, $3, OP_PIPE);
 	}
 
 	;
@@ -321,19 +499,19 @@ command:
 simple_command:
 
 	  exe_name BLANK params redirect {
-		$$ = bind_parts($1, $3, $4);
+		$$ = bind_parts(ctx, $1, $3, $4);
 	}
 
 	| exe_name BLANK params BLANK redirect {
-		$$ = bind_parts($1, $3, $5);
+		$$ = bind_parts(ctx, $1, $3, $5);
 	}
 
 	| exe_name redirect {
-		$$ = bind_parts($1, NULL, $2);
+		$$ = bind_parts(ctx, $1, NULL, $2);
 	}
 
 	| exe_name BLANK redirect {
-		$$ = bind_parts($1, NULL, $3);
+		$$ = bind_parts(ctx, $1, NULL, $3);
 	}
 
 	;
@@ -371,162 +549,111 @@ redirect:
 		$$.red_flags = IO_REGULAR;
 	}
 
-	| redirect REDIRECT_OE word {
-		$1.red_o = add_word_to_list($3, $1.red_o);
-		$1.red_e = add_word_to_list($3, $1.red_e);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_E word {
-		$1.red_e = add_word_to_list($3, $1.red_e);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_O word {
-		$1.red_o = add_word_to_list($3, $1.red_o);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_APPEND_E word {
-		$1.red_e = add_word_to_list($3, $1.red_e);
-		$1.red_flags |= IO_ERR_APPEND;
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_APPEND_O word {
-		$1.red_o = add_word_to_list($3, $1.red_o);
-		$1.red_flags |= IO_OUT_APPEND;
-		$$ = $1;
-	}
-
-	| redirect INDIRECT word {
-		$1.red_i = add_word_to_list($3, $1.red_i);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_OE word BLANK {
-		$1.red_o = add_word_to_list($3, $1.red_o);
-		$1.red_e = add_word_to_list($3, $1.red_e);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_E word BLANK {
-		$1.red_e = add_word_to_list($3, $1.red_e);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_O word BLANK {
-		$1.red_o = add_word_to_list($3, $1.red_o);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_APPEND_E word BLANK {
-		$1.red_e = add_word_to_list($3, $1.red_e);
-		$1.red_flags |= IO_ERR_APPEND;
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_APPEND_O word BLANK {
-		$1.red_o = add_word_to_list($3, $1.red_o);
-		$1.red_flags |= IO_OUT_APPEND;
-		$$ = $1;
-	}
-
-	| redirect INDIRECT word BLANK {
-		$1.red_i = add_word_to_list($3, $1.red_i);
-		$$ = $1;
-	}
-
-	| redirect REDIRECT_OE BLANK word {
+	| redirect REDIRECT_OE opt_blank word opt_blank {
 		$1.red_o = add_word_to_list($4, $1.red_o);
 		$1.red_e = add_word_to_list($4, $1.red_e);
+		/* Both streams go to the file, whatever they copied. */
+		set_target(&$1, 1, IO_TO_FILE);
+		set_target(&$1, 2, IO_TO_FILE);
 		$$ = $1;
 	}
 
-	| redirect REDIRECT_E BLANK word {
+	| redirect REDIRECT_E opt_blank word opt_blank {
+		set_target(&$1, 2, IO_TO_FILE);
 		$1.red_e = add_word_to_list($4, $1.red_e);
 		$$ = $1;
 	}
 
-	| redirect REDIRECT_O BLANK word {
+	| redirect REDIRECT_O opt_blank word opt_blank {
+		set_target(&$1, 1, IO_TO_FILE);
 		$1.red_o = add_word_to_list($4, $1.red_o);
 		$$ = $1;
 	}
 
-	| redirect REDIRECT_APPEND_E BLANK word {
+	| redirect REDIRECT_APPEND_E opt_blank word opt_blank {
+		set_target(&$1, 2, IO_TO_FILE);
 		$1.red_e = add_word_to_list($4, $1.red_e);
 		$1.red_flags |= IO_ERR_APPEND;
 		$$ = $1;
 	}
 
-	| redirect REDIRECT_APPEND_O BLANK word {
+	| redirect REDIRECT_APPEND_O opt_blank word opt_blank {
+		set_target(&$1, 1, IO_TO_FILE);
 		$1.red_o = add_word_to_list($4, $1.red_o);
 		$1.red_flags |= IO_OUT_APPEND;
 		$$ = $1;
 	}
 
-	| redirect INDIRECT BLANK word {
+	| redirect INDIRECT opt_blank word opt_blank {
 		$1.red_i = add_word_to_list($4, $1.red_i);
 		$$ = $1;
 	}
-	| redirect REDIRECT_OE BLANK word BLANK {
-		$1.red_o = add_word_to_list($4, $1.red_o);
-		$1.red_e = add_word_to_list($4, $1.red_e);
-		$$ = $1;
-	}
 
-	| redirect REDIRECT_E BLANK word BLANK {
-		$1.red_e = add_word_to_list($4, $1.red_e);
+	| redirect REDIRECT_E PARALLEL opt_blank word opt_blank {
+		if (!add_duplication(&$1, 2, $5)) {
+			yyerror(&yylloc, ctx, scanner, "invalid file descriptor");
+			YYABORT;
+		}
 		$$ = $1;
 	}
 
-	| redirect REDIRECT_O BLANK word BLANK {
-		$1.red_o = add_word_to_list($4, $1.red_o);
+	| redirect REDIRECT_O PARALLEL opt_blank word opt_blank {
+		if (!add_duplication(&$1, 1, $5)) {
+			yyerror(&yylloc, ctx, scanner, "invalid file descriptor");
+			YYABORT;
+		}
 		$$ = $1;
 	}
 
-	| redirect REDIRECT_APPEND_O BLANK word BLANK {
-		$1.red_o = add_word_to_list($4, $1.red_o);
-		$1.red_flags |= IO_OUT_APPEND;
-		$$ = $1;
-	}
+	;
 
-	| redirect REDIRECT_APPEND_E BLANK word BLANK {
-		$1.red_e = add_word_to_list($4, $1.red_e);
-		$1.red_flags |= IO_ERR_APPEND;
-		$$ = $1;
-	}
+opt_blank:
 
-	| redirect INDIRECT BLANK word BLANK {
-		$1.red_i = add_word_to_list($4, $1.red_i);
-		$$ = $1;
-	}
+	  /* empty */
+
+	| BLANK
 
 	;
 
 word:
 
 	  word WORD {
-		$$ = add_part_to_word(new_word($2, false), $1);
+		$$ = add_part_to_word(new_word(ctx, $2, false), $1);
 	}
 
 	| word ENV_VAR {
-		$$ = add_part_to_word(new_word($2, true), $1);
+		$$ = add_part_to_word(new_word(ctx, $2, true), $1);
 	}
 
 	| WORD {
-		$$ = new_word($1, false);
+		$$ = new_word(ctx, $1, false);
 	}
 
 	| ENV_VAR {
-		$$ = new_word($1, true);
+		$$ = new_word(ctx, $1, true);
 	}
 
 	;
 %%
 
 
-bool parse_line(const char * line, command_t ** root)
+parse_context_t * new_parse_context(void)
+{
+	parse_context_t * ctx = (parse_context_t *)calloc(1, sizeof(parse_context_t));
+
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->scanner = newScanner(ctx);
+	if (ctx->scanner == NULL) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+}
+
+
+bool parse_line_r(parse_context_t * ctx, const char * line, command_t ** root)
 {
 	if (*root != NULL) {
 		/* see the comment in parser.h */
@@ -540,48 +667,72 @@ bool parse_line(const char * line, command_t ** root)
 		return false;
 	}
 
-	free_parse_memory();
-	globalParseAnotherString(line);
-	needsFree = true;
-	command_root = NULL;
-
-	yylloc.first_line = yylloc.last_line = 1;
-	yylloc.first_column = yylloc.last_column = 0;
+	free_parse_memory_r(ctx);
+	scanString(ctx->scanner, line);
+	ctx->needsFree = true;
+	ctx->root = NULL;
 
-	if (yyparse() != 0) {
+	if (yyparse(ctx, ctx->scanner) != 0) {
 		/* yyparse failed */
 		return false;
 	}
 
-	*root = command_root;
+	*root = ctx->root;
 
 	return true;
 }
 
 
-void free_parse_memory()
+void free_parse_memory_r(parse_context_t * ctx)
 {
-	if (needsFree) {
-		globalEndParsing();
-		while (globalAllocCount != 0) {
-			globalAllocCount--;
-			assert(globalAllocMem[globalAllocCount] != NULL);
-			free(globalAllocMem[globalAllocCount]);
-			globalAllocMem[globalAllocCount] = NULL;
+	if (ctx->needsFree) {
+		/* the first chunk is kept for the next line, unless it is a big one */
+		if (ctx->firstChunk != NULL && ctx->firstChunk->size > PARSE_CHUNK_SIZE) {
+			freeChunks(ctx->firstChunk);
+			ctx->firstChunk = NULL;
+		} else if (ctx->firstChunk != NULL) {
+			freeChunks(ctx->firstChunk->next);
+			ctx->firstChunk->next = NULL;
 		}
+		ctx->currentChunk = NULL;
+		ctx->needsFree = false;
+	}
+}
 
-		if (globalAllocMem != NULL) {
-			free((void *)globalAllocMem);
-			globalAllocMem = NULL;
-		}
 
-		globalAllocSize = 0;
-		needsFree = false;
+void free_parse_context(parse_context_t * ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	freeScanner(ctx->scanner);
+	freeChunks(ctx->firstChunk);
+	free(ctx);
+}
+
+
+bool parse_line(const char * line, command_t ** root)
+{
+	if (globalContext == NULL) {
+		globalContext = new_parse_context();
+		if (globalContext == NULL) {
+			fprintf(stderr, "malloc() failed\n");
+			exit(EXIT_FAILURE);
+		}
 	}
+
+	return parse_line_r(globalContext, line, root);
+}
+
+
+void free_parse_memory()
+{
+	if (globalContext != NULL)
+		free_parse_memory_r(globalContext);
 }
 
 
-void yyerror(const char* str)
+void yyerror(YYLTYPE * loc, parse_context_t * ctx, void * scanner, const char * str)
 {
-	parse_error(str, yylloc.first_column);
+	parse_error(str, loc->first_column);
 }